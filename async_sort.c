@@ -0,0 +1,513 @@
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "async_sort.h"
+#include "cilk_sort.h"
+#include "pthread_sort.h"
+
+// Number of elements sorted or merged by one task. Every round of a job has
+// exactly one task per block of the array, which keeps tasks of different
+// jobs comparable in cost for the round robin scheduler.
+#define BLOCK_SIZE 65536
+
+#define TRUE 1
+#define FALSE 0
+
+///////////////////////////////////////////////////////////////////////////////
+//                             Type Declarations                             //
+///////////////////////////////////////////////////////////////////////////////
+
+// Round 0 sorts each block of the source; round r > 0 merges pairs of runs
+// of BLOCK_SIZE << (r - 1) elements. The task for block t of a merge round
+// produces output elements [t * BLOCK_SIZE, (t + 1) * BLOCK_SIZE) of its
+// pair, locating its inputs by co-ranking, so merge tasks are independent.
+struct SortJob
+{
+  SortPool_t *pool;
+
+  long *source;
+  long *result;
+  long *scratch;
+  long size;
+  long block_count;
+
+  int round;
+  int round_count;
+
+  // next task of the current round to hand out, tasks of the current round
+  // that have completed and tasks currently executing
+  long next_task;
+  long tasks_done;
+  long running;
+
+  int cancel_requested;
+  int finishing;
+  int in_callback;
+  int released;
+  SortJobState_t state;
+
+  SortCallback_t callback;
+  void *user_data;
+  int event_fd;
+
+  pthread_cond_t done;
+
+  // links of the pool's list of in-flight jobs
+  SortJob_t *prev;
+  SortJob_t *next;
+};
+
+struct SortPool
+{
+  // protects the pool and every job submitted to it
+  pthread_mutex_t mutex;
+
+  // signalled when new tasks become available or the workers must exit
+  pthread_cond_t work_ready;
+
+  // signalled when the list of in-flight jobs becomes empty
+  pthread_cond_t all_done;
+
+  pthread_t *workers;
+  int worker_count;
+  int shutdown;
+
+  // in-flight jobs and the job the next idle worker looks at first
+  SortJob_t *jobs;
+  SortJob_t *cursor;
+
+  // serial context for the block sorts; the pool's workers are the
+  // parallelism
+  SortContext_t *block_ctx;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//                          Function Implementation                          //
+///////////////////////////////////////////////////////////////////////////////
+
+static void merge_range( long *result, long *array_b, long b_size, long *array_c, long c_size )
+{
+  while( b_size > 0 && c_size > 0 )
+  {
+    if(*array_b <= *array_c)
+    {
+      *result++ = *array_b++; b_size--;
+    }
+    else
+    {
+      *result++ = *array_c++; c_size--;
+    }
+  }
+
+  memcpy( result, array_b, sizeof(long) * b_size );
+  memcpy( result + b_size, array_c, sizeof(long) * c_size );
+}
+
+static long *round_output( SortJob_t *job, int round )
+{
+  return ((job->round_count - 1 - round) % 2 == 0) ? job->result : job->scratch;
+}
+
+static void execute_task( SortJob_t *job, int round, long task )
+{
+  long start = task * BLOCK_SIZE;
+  long end = start + BLOCK_SIZE < job->size ? start + BLOCK_SIZE : job->size;
+  long *output = round_output( job, round );
+
+  if(round == 0)
+  {
+    pthread_sort_into_ctx( job->pool->block_ctx, output + start, job->source + start, end - start );
+    return;
+  }
+
+  long *input = round_output( job, round - 1 );
+  long width = (long)BLOCK_SIZE << (round - 1);
+  long pair_start = (start / (2 * width)) * (2 * width);
+  long b_size = job->size - pair_start < width ? job->size - pair_start : width;
+  long c_size = job->size - pair_start - b_size < width ? job->size - pair_start - b_size : width;
+  long *array_b = input + pair_start;
+  long *array_c = array_b + b_size;
+
+  long b_first = co_rank( start - pair_start, array_b, b_size, array_c, c_size );
+  long b_last  = co_rank( end - pair_start, array_b, b_size, array_c, c_size );
+  long c_first = start - pair_start - b_first;
+  long c_last  = end - pair_start - b_last;
+
+  merge_range( output + start, array_b + b_first, b_last - b_first, array_c + c_first, c_last - c_first );
+}
+
+static void free_job( SortJob_t *job )
+{
+  if(job->event_fd >= 0)
+  {
+    close(job->event_fd);
+  }
+  pthread_cond_destroy( &job->done );
+  free(job->scratch);
+  free(job);
+}
+
+static void signal_eventfd( int event_fd )
+{
+  uint64_t one = 1;
+  if(write( event_fd, &one, sizeof(one) ) != sizeof(one))
+  {
+    printf("ERROR: Failed to signal job eventfd\n");
+  }
+}
+
+// Retires job with the given final state. Must be called with the mutex
+// held; it is released while the user callback runs.
+static void finish_job( SortPool_t *pool, SortJob_t *job, SortJobState_t state )
+{
+  job->finishing = TRUE;
+
+  if(job->prev != NULL)
+  {
+    job->prev->next = job->next;
+  }
+  else
+  {
+    pool->jobs = job->next;
+  }
+  if(job->next != NULL)
+  {
+    job->next->prev = job->prev;
+  }
+  if(pool->cursor == job)
+  {
+    pool->cursor = job->next;
+  }
+
+  // publish the final state before the callback runs, so that it (and
+  // anyone it notifies) sees sort_poll and sort_wait agree with it
+  job->state = state;
+  free(job->scratch);
+  job->scratch = NULL;
+  if(job->event_fd >= 0)
+  {
+    signal_eventfd( job->event_fd );
+  }
+  pthread_cond_broadcast( &job->done );
+
+  if(job->callback != NULL)
+  {
+    // a release during the callback defers freeing the job to below
+    job->in_callback = TRUE;
+    pthread_mutex_unlock( &pool->mutex );
+    job->callback( job, state, job->user_data );
+    pthread_mutex_lock( &pool->mutex );
+    job->in_callback = FALSE;
+  }
+
+  if(pool->jobs == NULL)
+  {
+    pthread_cond_broadcast( &pool->all_done );
+  }
+
+  if(job->released == TRUE)
+  {
+    free_job( job );
+  }
+}
+
+// Returns a job with a task ready to run, scanning round robin from the
+// cursor. Must be called with the mutex held.
+static SortJob_t *next_ready_job( SortPool_t *pool )
+{
+  SortJob_t *start = pool->cursor != NULL ? pool->cursor : pool->jobs;
+  SortJob_t *job = start;
+
+  while(job != NULL)
+  {
+    if(job->cancel_requested == FALSE && job->next_task < job->block_count)
+    {
+      pool->cursor = job->next;
+      return job;
+    }
+
+    job = job->next != NULL ? job->next : pool->jobs;
+    if(job == start)
+    {
+      break;
+    }
+  }
+
+  return NULL;
+}
+
+static void* pool_worker( void *args )
+{
+  SortPool_t *pool = (SortPool_t*)args;
+
+  pthread_mutex_lock( &pool->mutex );
+  while(TRUE)
+  {
+    SortJob_t *job = next_ready_job( pool );
+    if(job == NULL)
+    {
+      if(pool->shutdown == TRUE)
+      {
+        break;
+      }
+      pthread_cond_wait( &pool->work_ready, &pool->mutex );
+      continue;
+    }
+
+    int round = job->round;
+    long task = job->next_task++;
+    job->running++;
+    pthread_mutex_unlock( &pool->mutex );
+
+    execute_task( job, round, task );
+
+    pthread_mutex_lock( &pool->mutex );
+    job->running--;
+    job->tasks_done++;
+
+    if(job->cancel_requested == TRUE)
+    {
+      // the last task in flight retires a cancelled job
+      if(job->running == 0 && job->finishing == FALSE)
+      {
+        finish_job( pool, job, SORT_JOB_CANCELLED );
+      }
+    }
+    else if(job->tasks_done == job->block_count)
+    {
+      // the round is complete; either start the next one or finish
+      if(job->round + 1 == job->round_count)
+      {
+        finish_job( pool, job, SORT_JOB_DONE );
+      }
+      else
+      {
+        job->round++;
+        job->next_task  = 0;
+        job->tasks_done = 0;
+        pthread_cond_broadcast( &pool->work_ready );
+      }
+    }
+  }
+  pthread_mutex_unlock( &pool->mutex );
+
+  return NULL;
+}
+
+SortPool_t *sort_pool_create( int num_of_threads )
+{
+  if(num_of_threads < 1)
+  {
+    num_of_threads = 1;
+  }
+
+  SortPool_t *pool = calloc(1, sizeof(SortPool_t));
+  pthread_t *workers = malloc(sizeof(pthread_t) * num_of_threads);
+  SortContext_t *block_ctx = pthread_sort_context_create( 0 );
+  if(pool == 0 || workers == 0 || block_ctx == NULL)
+  {
+    printf("Insufficient Memory\n");
+    free(pool);
+    free(workers);
+    pthread_sort_context_destroy( block_ctx );
+    return NULL;
+  }
+
+  pool->workers   = workers;
+  pool->block_ctx = block_ctx;
+  pthread_mutex_init( &pool->mutex, NULL );
+  pthread_cond_init( &pool->work_ready, NULL );
+  pthread_cond_init( &pool->all_done, NULL );
+
+  for( pool->worker_count = 0; pool->worker_count < num_of_threads; pool->worker_count++ )
+  {
+    if(pthread_create( &workers[pool->worker_count], NULL, &pool_worker, pool ) != 0)
+    {
+      printf("ERROR: Failed to create pool worker\n");
+      break;
+    }
+  }
+
+  if(pool->worker_count == 0)
+  {
+    sort_pool_destroy( pool );
+    return NULL;
+  }
+
+  return pool;
+}
+
+// Must be called with the mutex held
+static void cancel_job( SortPool_t *pool, SortJob_t *job )
+{
+  job->cancel_requested = TRUE;
+
+  // with no task in flight there is no worker left to retire the job
+  if(job->running == 0 && job->finishing == FALSE)
+  {
+    finish_job( pool, job, SORT_JOB_CANCELLED );
+  }
+}
+
+void sort_pool_destroy( SortPool_t *pool )
+{
+  if(pool == NULL)
+  {
+    return;
+  }
+
+  pthread_mutex_lock( &pool->mutex );
+  SortJob_t *job = pool->jobs;
+  while(job != NULL)
+  {
+    SortJob_t *next = job->next;
+    if(job->cancel_requested == FALSE)
+    {
+      cancel_job( pool, job );
+      next = pool->jobs;
+    }
+    job = next;
+  }
+  while(pool->jobs != NULL)
+  {
+    pthread_cond_wait( &pool->all_done, &pool->mutex );
+  }
+  pool->shutdown = TRUE;
+  pthread_cond_broadcast( &pool->work_ready );
+  pthread_mutex_unlock( &pool->mutex );
+
+  int i;
+  for( i = 0; i < pool->worker_count; i++ )
+  {
+    pthread_join( pool->workers[i], NULL );
+  }
+
+  pthread_cond_destroy( &pool->all_done );
+  pthread_cond_destroy( &pool->work_ready );
+  pthread_mutex_destroy( &pool->mutex );
+  pthread_sort_context_destroy( pool->block_ctx );
+  free(pool->workers);
+  free(pool);
+}
+
+SortJob_t *sort_submit( SortPool_t *pool, long *result, long *source, long size,
+                        SortCallback_t callback, void *user_data )
+{
+  SortJob_t *job = calloc(1, sizeof(SortJob_t));
+  if(job == 0)
+  {
+    printf("Insufficient Memory\n");
+    return NULL;
+  }
+
+  job->pool        = pool;
+  job->source      = source;
+  job->result      = result;
+  job->size        = size > 0 ? size : 0;
+  job->block_count = job->size > 0 ? (job->size + BLOCK_SIZE - 1) / BLOCK_SIZE : 1;
+  job->round_count = 1;
+  while(((long)1 << (job->round_count - 1)) < job->block_count)
+  {
+    job->round_count++;
+  }
+  job->state     = SORT_JOB_RUNNING;
+  job->callback  = callback;
+  job->user_data = user_data;
+  job->event_fd  = -1;
+  pthread_cond_init( &job->done, NULL );
+
+  if(job->round_count > 1)
+  {
+    job->scratch = malloc(sizeof(long) * job->size);
+    if(job->scratch == 0)
+    {
+      printf("ERROR: Insufficient Memory; size=%ld\n", job->size);
+      free_job( job );
+      return NULL;
+    }
+  }
+
+  pthread_mutex_lock( &pool->mutex );
+  job->next = pool->jobs;
+  if(pool->jobs != NULL)
+  {
+    pool->jobs->prev = job;
+  }
+  pool->jobs = job;
+  pthread_cond_broadcast( &pool->work_ready );
+  pthread_mutex_unlock( &pool->mutex );
+
+  return job;
+}
+
+SortJobState_t sort_poll( SortJob_t *job )
+{
+  pthread_mutex_lock( &job->pool->mutex );
+  SortJobState_t state = job->state;
+  pthread_mutex_unlock( &job->pool->mutex );
+  return state;
+}
+
+SortJobState_t sort_wait( SortJob_t *job )
+{
+  pthread_mutex_lock( &job->pool->mutex );
+  while(job->state == SORT_JOB_RUNNING)
+  {
+    pthread_cond_wait( &job->done, &job->pool->mutex );
+  }
+  SortJobState_t state = job->state;
+  pthread_mutex_unlock( &job->pool->mutex );
+  return state;
+}
+
+void sort_cancel( SortJob_t *job )
+{
+  SortPool_t *pool = job->pool;
+
+  pthread_mutex_lock( &pool->mutex );
+  if(job->finishing == FALSE && job->cancel_requested == FALSE)
+  {
+    cancel_job( pool, job );
+  }
+  pthread_mutex_unlock( &pool->mutex );
+}
+
+int sort_job_eventfd( SortJob_t *job )
+{
+  pthread_mutex_lock( &job->pool->mutex );
+  if(job->event_fd < 0)
+  {
+    job->event_fd = eventfd( 0, EFD_CLOEXEC | EFD_NONBLOCK );
+    if(job->event_fd >= 0 && job->state != SORT_JOB_RUNNING)
+    {
+      signal_eventfd( job->event_fd );
+    }
+  }
+  int event_fd = job->event_fd;
+  pthread_mutex_unlock( &job->pool->mutex );
+  return event_fd;
+}
+
+void sort_job_release( SortJob_t *job )
+{
+  SortPool_t *pool = job->pool;
+
+  pthread_mutex_lock( &pool->mutex );
+  if(job->state == SORT_JOB_RUNNING || job->in_callback == TRUE)
+  {
+    job->released = TRUE;
+    job = NULL;
+  }
+  pthread_mutex_unlock( &pool->mutex );
+
+  if(job != NULL)
+  {
+    free_job( job );
+  }
+}
@@ -0,0 +1,52 @@
+#ifndef _ASYNC_SORT_H_
+#define _ASYNC_SORT_H_
+
+// Opaque pool of worker threads that executes submitted sorts. Every sort is
+// broken into equally sized tasks (block sorts, then merge pieces) and the
+// workers take one task from each in-flight sort in turn, so a large sort
+// cannot starve the small ones submitted after it.
+typedef struct SortPool SortPool_t;
+
+// Handle of one submitted sort
+typedef struct SortJob SortJob_t;
+
+typedef enum
+{
+  SORT_JOB_RUNNING,
+  SORT_JOB_DONE,
+  SORT_JOB_CANCELLED
+} SortJobState_t;
+
+// Invoked on a worker thread (or on the thread calling sort_cancel) once
+// the job has finished, after its final state is visible to sort_poll and
+// sort_wait and its eventfd is signalled; it must not call sort_job_release
+// on the job
+typedef void (*SortCallback_t)( SortJob_t *job, SortJobState_t state, void *user_data );
+
+SortPool_t *sort_pool_create( int num_of_threads );
+
+// Cancels every outstanding job, waits for them and stops the workers
+void sort_pool_destroy( SortPool_t *pool );
+
+// Starts sorting source into result (which may be source itself) and returns
+// at once. callback may be NULL.
+SortJob_t *sort_submit( SortPool_t *pool, long *result, long *source, long size,
+                        SortCallback_t callback, void *user_data );
+
+// Returns the current state of job without blocking
+SortJobState_t sort_poll( SortJob_t *job );
+
+// Blocks until job has finished and returns its final state
+SortJobState_t sort_wait( SortJob_t *job );
+
+// Requests that job stop; tasks already running complete, no new ones start
+void sort_cancel( SortJob_t *job );
+
+// Returns an eventfd that becomes readable when job finishes, for use in an
+// event loop; it is owned by the job and closed by sort_job_release
+int sort_job_eventfd( SortJob_t *job );
+
+// Gives up the handle; the job is freed once it has finished
+void sort_job_release( SortJob_t *job );
+
+#endif  // _ASYNC_SORT_H_
@@ -0,0 +1,79 @@
+#ifndef _AUTO_SORT_H_
+#define _AUTO_SORT_H_
+
+// Engines the automatic entry point chooses between
+typedef enum
+{
+  ENGINE_PRESORTED,   // input already sorted; copied through
+  ENGINE_SERIAL,      // pthread engine with no helper threads
+  ENGINE_COUNTING,    // cilk low cardinality histogram path
+  ENGINE_CILK,        // cilk MergeSort
+  ENGINE_CACHE,       // cache-aware cilk sort
+  ENGINE_PTHREAD,     // pthread engine using every core
+  ENGINE_COUNT
+} SortEngine_t;
+
+// Predicted running time of each engine on n keys of sortedness s:
+//   overhead[e] + per_unit[e] * units(e, n) * (1 - sorted_gain[e] * order(s))
+// where units is n for the counting and presorted paths and n log2 n for
+// the comparison sorts, and order(s) = max(0, 2s - 1) runs from 0 for
+// random input to 1 for sorted input; sorted_gain is negative for engines
+// that slow down on sorted input. per_unit of the pthread engine is
+// taken with every core; on t threads it becomes
+//   per_unit * ((1 - f) + f / t) / ((1 - f) + f / cores)
+// for the parallel fraction f, plus thread_cost per helper thread. The
+// pthread engine's leaf quicksort degrades on sorted runs, so it gets its
+// own serial cut-off for nearly sorted input (sorted_cutoff, used when
+// order(s) > 0.5) besides the one for other input (cutoff); the sorted_gain
+// of the serial and pthread engines is measured at sorted_cutoff. The
+// coefficients and the cut-offs are measured on the machine by
+// auto_sort_calibrate and persisted to a text file.
+typedef struct
+{
+  double overhead[ENGINE_COUNT];
+  double per_unit[ENGINE_COUNT];
+  double sorted_gain[ENGINE_COUNT];
+  double parallel_fraction;
+  double thread_cost;
+  long cutoff;
+  long sorted_cutoff;
+} CostModel_t;
+
+// Decision taken for one input, with the sample statistics behind it
+typedef struct
+{
+  SortEngine_t engine;
+  int thread_count;
+  long threshold;
+  double sortedness;     // fraction of sampled neighbour pairs in order
+  long distinct;         // estimated number of distinct keys
+  double predicted;      // predicted seconds for the chosen engine
+} SortPlan_t;
+
+const char *sort_engine_name( SortEngine_t engine );
+
+// Conservative built-in coefficients for use before any calibration
+void auto_sort_default_model( CostModel_t *model );
+
+// Reads/writes a model file; loading returns 0 (leaving model unchanged)
+// when the file is missing or malformed
+int auto_sort_load_model( CostModel_t *model, const char *path );
+int auto_sort_save_model( const CostModel_t *model, const char *path );
+
+// Benchmarks every engine on this machine, fits model and saves it to path
+int auto_sort_calibrate( CostModel_t *model, const char *path );
+
+// Chooses engine, thread count and cut-off for array; the thread count is
+// chosen for the pthread engine only, the cilk engines use every worker
+SortPlan_t auto_sort_plan( const CostModel_t *model, long *array, long size );
+
+// Sorts source into result as plan says; the plan may come from
+// auto_sort_plan (possibly adjusted) or name an engine directly
+void auto_sort_run( const SortPlan_t *plan, long *result, long *source, long size );
+
+// Sorts source into result with the engine chosen by auto_sort_plan; the
+// plan is returned through plan when it is not NULL
+void auto_sort_into( const CostModel_t *model, long *result, long *source, long size, SortPlan_t *plan );
+long *auto_sort( const CostModel_t *model, long *array, long size, SortPlan_t *plan );
+
+#endif  // _AUTO_SORT_H_
@@ -0,0 +1,682 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cilk_sort.h"
+#include "fork_join.h"
+
+// Specifies the cut-off size of the array before it switches from
+// parallel merges/sorts to a serial implementation
+#ifndef THRESHOLD
+#define THRESHOLD 512
+#endif
+
+// Approximate number of positions of the final merge handled by one strand
+#define PIECE_SIZE 16384
+
+#define TRUE 1
+#define FALSE 0
+
+typedef struct
+{
+  long key;
+  long value;
+} KeyValue_t;
+
+// One piece of the final merge: slices of the two halves cut at exact
+// co-ranks, so that every piece merges the same number of keys. A run of
+// equal keys may straddle pieces; it belongs to the earliest piece holding
+// it (the owner). A piece whose first run continues the owner's last one
+// sets skip, leaves that run out of count and hands its partial aggregate,
+// head, to the owner's last entry. The piece writes its count entries at
+// offset.
+typedef struct
+{
+  MergeSlice_t slice;
+  long first_key;
+  long last_key;
+  int skip;
+  long owner;
+  long head;
+  long count;
+  long offset;
+} Piece_t;
+
+// State of one fused merge: the two sorted halves (keys only, or key/value
+// pairs when pairs_b is set) and the pieces. keys and values receive the
+// aggregated entries; both are NULL during the count pass, and values is
+// NULL for cilk_sort_unique.
+typedef struct
+{
+  long *keys_b;
+  long *keys_c;
+  KeyValue_t *pairs_b;
+  KeyValue_t *pairs_c;
+  long b_size;
+  long c_size;
+  Aggregate_t op;
+  long *keys;
+  long *values;
+  Piece_t *pieces;
+  long piece_count;
+} FusedMerge_t;
+
+///////////////////////////////////////////////////////////////////////////////
+//                          Function Implementation                          //
+///////////////////////////////////////////////////////////////////////////////
+
+static inline long combine( long a, long b, Aggregate_t op )
+{
+  switch(op)
+  {
+  case AGGREGATE_MIN:
+    return a < b ? a : b;
+  case AGGREGATE_MAX:
+    return a > b ? a : b;
+  case AGGREGATE_SUM:
+  default:
+    return a + b;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                         Key/value merge sort                              //
+///////////////////////////////////////////////////////////////////////////////
+
+static inline void swap_pairs( KeyValue_t *pairs, long i, long j )
+{
+  KeyValue_t tmp = pairs[i];
+  pairs[i] = pairs[j];
+  pairs[j] = tmp;
+}
+
+// Serial quicksort of pairs by key with a three way partition, so runs of
+// equal keys are finished in one pass
+static void kv_quicksort( KeyValue_t *pairs, long size )
+{
+  while(size > 1)
+  {
+    long pivot = pairs[size / 2].key;
+    long lt = 0;
+    long gt = size - 1;
+    long i = 0;
+
+    while(i <= gt)
+    {
+      if(pairs[i].key < pivot)
+      {
+        swap_pairs( pairs, lt++, i++ );
+      }
+      else if(pairs[i].key > pivot)
+      {
+        swap_pairs( pairs, i, gt-- );
+      }
+      else
+      {
+        i++;
+      }
+    }
+
+    // recurse into the smaller side, loop on the larger one
+    if(lt < size - gt - 1)
+    {
+      kv_quicksort( pairs, lt );
+      pairs += gt + 1;
+      size  -= gt + 1;
+    }
+    else
+    {
+      kv_quicksort( pairs + gt + 1, size - gt - 1 );
+      size = lt;
+    }
+  }
+}
+
+static void kv_s_merge( KeyValue_t *result, KeyValue_t *array_b, long b_size, KeyValue_t *array_c, long c_size )
+{
+
+  while( b_size > 0 && c_size > 0 )
+  {
+    if(array_b->key <= array_c->key)
+    {
+      *result++ = *array_b++; b_size--;
+    }
+    else
+    {
+      *result++ = *array_c++; c_size--;
+    }
+  }
+
+  memcpy( result, array_b, sizeof(KeyValue_t) * b_size );
+  memcpy( result + b_size, array_c, sizeof(KeyValue_t) * c_size );
+
+}
+
+// Number of pairs of search_array whose key is smaller than key
+static long kv_binary_search( KeyValue_t *search_array, long array_size, long key )
+{
+  long min = 0;
+  long max = array_size;
+
+  while(min < max)
+  {
+    long mid = min + (max - min) / 2;
+    if(search_array[mid].key < key)
+    {
+      min = mid + 1;
+    }
+    else
+    {
+      max = mid;
+    }
+  }
+
+  return min;
+}
+
+static void kv_p_merge( KeyValue_t *result, KeyValue_t *array_b, long b_size, KeyValue_t *array_c, long c_size )
+{
+
+  // invert the array that is considered B as B needs to be the larger one
+  if(b_size < c_size)
+  {
+    kv_p_merge( result, array_c, c_size, array_b, b_size );
+  }
+  else if( b_size <= THRESHOLD || c_size == 0 )
+  {
+    // perform sequential merge rather than parallel
+    kv_s_merge( result, array_b, b_size, array_c, c_size );
+  }
+  else
+  {
+    long mid_index = b_size / 2;
+    long bin_index = kv_binary_search( array_c, c_size, array_b[mid_index].key );
+
+    result[mid_index + bin_index] = array_b[mid_index];
+
+    cilk_spawn kv_p_merge( result, array_b, mid_index, array_c, bin_index );
+    kv_p_merge( result + mid_index + bin_index + 1, array_b + mid_index + 1, b_size - mid_index - 1, array_c + bin_index, c_size - bin_index );
+    cilk_sync;
+  }
+
+}
+
+static void kv_merge_sort( KeyValue_t *result, KeyValue_t *source, long size )
+{
+
+  if(size <= THRESHOLD)
+  {
+    if(result != source)
+    {
+      memcpy( result, source, sizeof(KeyValue_t) * size );
+    }
+    kv_quicksort( result, size );
+  }
+  else
+  {
+
+    KeyValue_t *C = malloc(size * sizeof(KeyValue_t));
+    if(C == 0)
+    {
+      printf("ERROR: Insufficient Memory; size=%ld\n", size);
+      exit(-1);
+    }
+
+    cilk_spawn kv_merge_sort(C, source, size / 2);
+    kv_merge_sort(C + (size / 2), source + (size / 2), size - (size / 2));
+    cilk_sync;
+
+    kv_p_merge( result, C, (size / 2), C + (size / 2), size - (size / 2) );
+
+    free(C);
+  }
+
+}
+
+// Number of pairs of B among the first k pairs of the merge of B and C,
+// ties taken from B first (as kv_s_merge does)
+static long kv_co_rank( long k, KeyValue_t *array_b, long b_size, KeyValue_t *array_c, long c_size )
+{
+  long lo = k > c_size ? k - c_size : 0;
+  long hi = k < b_size ? k : b_size;
+
+  while(lo < hi)
+  {
+    long i = lo + (hi - lo) / 2;
+    if(array_b[i].key <= array_c[k - i - 1].key)
+    {
+      lo = i + 1;
+    }
+    else
+    {
+      hi = i;
+    }
+  }
+
+  return lo;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                            Fused final merge                              //
+///////////////////////////////////////////////////////////////////////////////
+
+// Merges two sorted key ranges and writes one entry per run of equal keys,
+// the key to keys and its number of occurrences to counts (either skipped
+// when NULL). With skip set the first run is not written; its occurrences
+// are counted into head instead (when not NULL). Returns the number of
+// runs, the skipped one included.
+static long aggregate_keys( long *keys, long *counts, int skip, long *head, long *array_b, long b_size, long *array_c, long c_size )
+{
+  long count = 0;
+  long last = 0;
+  long *slot = NULL;
+
+  while( b_size > 0 || c_size > 0 )
+  {
+    long key;
+    if(c_size == 0 || (b_size > 0 && *array_b <= *array_c))
+    {
+      key = *array_b++; b_size--;
+    }
+    else
+    {
+      key = *array_c++; c_size--;
+    }
+
+    if(count > 0 && last == key)
+    {
+      if(slot)
+      {
+        (*slot)++;
+      }
+    }
+    else
+    {
+      long index = count - skip;
+      if(index < 0)
+      {
+        slot = head;
+      }
+      else
+      {
+        if(keys)
+        {
+          keys[index] = key;
+        }
+        slot = counts ? &counts[index] : NULL;
+      }
+      if(slot)
+      {
+        *slot = 1;
+      }
+      last = key;
+      count++;
+    }
+  }
+
+  return count;
+}
+
+// Merges two sorted pair ranges and writes one entry per run of equal keys,
+// the key to keys and its values reduced by op to values (either skipped
+// when NULL). With skip set the first run is not written; its values are
+// reduced into head instead (when not NULL). Returns the number of runs,
+// the skipped one included.
+static long aggregate_pairs( long *keys, long *values, int skip, long *head, KeyValue_t *array_b, long b_size, KeyValue_t *array_c, long c_size, Aggregate_t op )
+{
+  long count = 0;
+  long last = 0;
+  long *slot = NULL;
+
+  while( b_size > 0 || c_size > 0 )
+  {
+    KeyValue_t pair;
+    if(c_size == 0 || (b_size > 0 && array_b->key <= array_c->key))
+    {
+      pair = *array_b++; b_size--;
+    }
+    else
+    {
+      pair = *array_c++; c_size--;
+    }
+
+    if(count > 0 && last == pair.key)
+    {
+      if(slot)
+      {
+        *slot = combine( *slot, pair.value, op );
+      }
+    }
+    else
+    {
+      long index = count - skip;
+      if(index < 0)
+      {
+        slot = head;
+      }
+      else
+      {
+        if(keys)
+        {
+          keys[index] = pair.key;
+        }
+        slot = values ? &values[index] : NULL;
+      }
+      if(slot)
+      {
+        *slot = pair.value;
+      }
+      last = pair.key;
+      count++;
+    }
+  }
+
+  return count;
+}
+
+// Cuts the halves at the co-ranks of the piece's output range and records
+// the first and last key it merges. Called by the count pass.
+static void cut_piece( FusedMerge_t *fused, Piece_t *piece, long start, long end )
+{
+  if(fused->pairs_b != NULL)
+  {
+    piece->slice.b_first = kv_co_rank( start, fused->pairs_b, fused->b_size, fused->pairs_c, fused->c_size );
+    piece->slice.b_last  = kv_co_rank( end, fused->pairs_b, fused->b_size, fused->pairs_c, fused->c_size );
+    piece->slice.c_first = start - piece->slice.b_first;
+    piece->slice.c_last  = end - piece->slice.b_last;
+  }
+  else
+  {
+    merge_slice( &piece->slice, start, end, fused->keys_b, fused->b_size, fused->keys_c, fused->c_size, FALSE );
+  }
+
+  if(start == end)
+  {
+    return;
+  }
+
+  long b_head, c_head, b_tail, c_tail;
+  int has_b = piece->slice.b_first < piece->slice.b_last;
+  int has_c = piece->slice.c_first < piece->slice.c_last;
+  if(fused->pairs_b != NULL)
+  {
+    b_head = has_b ? fused->pairs_b[piece->slice.b_first].key : 0;
+    b_tail = has_b ? fused->pairs_b[piece->slice.b_last - 1].key : 0;
+    c_head = has_c ? fused->pairs_c[piece->slice.c_first].key : 0;
+    c_tail = has_c ? fused->pairs_c[piece->slice.c_last - 1].key : 0;
+  }
+  else
+  {
+    b_head = has_b ? fused->keys_b[piece->slice.b_first] : 0;
+    b_tail = has_b ? fused->keys_b[piece->slice.b_last - 1] : 0;
+    c_head = has_c ? fused->keys_c[piece->slice.c_first] : 0;
+    c_tail = has_c ? fused->keys_c[piece->slice.c_last - 1] : 0;
+  }
+  piece->first_key = !has_c || (has_b && b_head <= c_head) ? b_head : c_head;
+  piece->last_key  = !has_c || (has_b && b_tail >= c_tail) ? b_tail : c_tail;
+}
+
+// Aggregates every piece; the count pass (NULL keys) cuts the halves and
+// records the number of runs of each piece, the write pass stores each
+// piece's entries at its offset
+static void aggregate_pieces( FusedMerge_t *fused, long first_piece, long last_piece )
+{
+  if(last_piece - first_piece > 1)
+  {
+    long mid_piece = first_piece + (last_piece - first_piece) / 2;
+    cilk_spawn aggregate_pieces( fused, first_piece, mid_piece );
+    aggregate_pieces( fused, mid_piece, last_piece );
+    cilk_sync;
+    return;
+  }
+
+  Piece_t *piece = &fused->pieces[first_piece];
+  long total = fused->b_size + fused->c_size;
+  int skip = FALSE;
+  long *keys = NULL;
+  long *values = NULL;
+  long *head = NULL;
+
+  if(fused->keys == NULL)
+  {
+    cut_piece( fused, piece, first_piece * total / fused->piece_count,
+               (first_piece + 1) * total / fused->piece_count );
+  }
+  else
+  {
+    skip   = piece->skip;
+    keys   = fused->keys + piece->offset;
+    values = fused->values ? fused->values + piece->offset : NULL;
+    head   = fused->values ? &piece->head : NULL;
+  }
+
+  long b_size = piece->slice.b_last - piece->slice.b_first;
+  long c_size = piece->slice.c_last - piece->slice.c_first;
+  long count;
+
+  if(fused->pairs_b != NULL)
+  {
+    count = aggregate_pairs( keys, values, skip, head,
+                             fused->pairs_b + piece->slice.b_first, b_size,
+                             fused->pairs_c + piece->slice.c_first, c_size, fused->op );
+  }
+  else
+  {
+    count = aggregate_keys( keys, values, skip, head,
+                            fused->keys_b + piece->slice.b_first, b_size,
+                            fused->keys_c + piece->slice.c_first, c_size );
+  }
+
+  if(fused->keys == NULL)
+  {
+    piece->count = count;
+  }
+}
+
+// Boundary step between the passes: a piece whose first key equals the last
+// key of the output so far continues that run, which stays with its owner.
+// Turns the remaining counts into output offsets; returns the total.
+static long stitch_pieces( FusedMerge_t *fused )
+{
+  long total = 0;
+  long owner = -1;
+  long p;
+
+  for( p = 0; p < fused->piece_count; p++ )
+  {
+    Piece_t *piece = &fused->pieces[p];
+    piece->skip  = FALSE;
+    piece->owner = -1;
+
+    if(piece->count > 0)
+    {
+      if(owner >= 0 && fused->pieces[owner].last_key == piece->first_key)
+      {
+        piece->skip  = TRUE;
+        piece->owner = owner;
+        piece->count--;
+      }
+      if(piece->count > 0)
+      {
+        owner = p;
+      }
+    }
+
+    piece->offset = total;
+    total += piece->count;
+  }
+
+  return total;
+}
+
+// Folds the partial aggregate of every skipped run into its owner's last
+// entry, once the write pass is done
+static void fold_heads( FusedMerge_t *fused )
+{
+  long p;
+  for( p = 0; p < fused->piece_count; p++ )
+  {
+    Piece_t *piece = &fused->pieces[p];
+    if(piece->skip)
+    {
+      Piece_t *owner = &fused->pieces[piece->owner];
+      long *entry = &fused->values[owner->offset + owner->count - 1];
+      *entry = combine( *entry, piece->head, fused->op );
+    }
+  }
+}
+
+// Runs the final merge of the two sorted halves described by fused twice
+// over pieces of equal merge ranges: once to count the runs of every
+// piece, then, after the boundary step and a prefix sum, again to write
+// them straight to their offsets in keys (and values, when not NULL), so
+// only the output entries are ever stored. keys and values must not
+// overlap the halves.
+static long fused_merge( FusedMerge_t *fused, long *keys, long *values )
+{
+  long total = fused->b_size + fused->c_size;
+  fused->piece_count = (total + PIECE_SIZE - 1) / PIECE_SIZE;
+
+  fused->pieces = malloc(sizeof(Piece_t) * fused->piece_count);
+  if(fused->pieces == 0)
+  {
+    printf("ERROR: Insufficient Memory; size=%ld\n", fused->piece_count);
+    exit(-1);
+  }
+
+  // Step 1. Cut the halves into pieces and count the runs of each
+  fused->keys   = NULL;
+  fused->values = NULL;
+  FORK_JOIN_ROOT( aggregate_pieces( fused, 0, fused->piece_count ) );
+
+  // Step 2. Hand runs straddling pieces to their owners and turn the counts
+  //         into output offsets
+  long distinct = stitch_pieces( fused );
+
+  // Step 3. Write every piece at its offset, then fold the straddling runs
+  fused->keys   = keys;
+  fused->values = values;
+  FORK_JOIN_ROOT( aggregate_pieces( fused, 0, fused->piece_count ) );
+  if(values != NULL)
+  {
+    fold_heads( fused );
+  }
+
+  free(fused->pieces);
+
+  return distinct;
+}
+
+static void sort_halves( long *result, long *source, long size )
+{
+  cilk_spawn MergeSort( result, source, size / 2 );
+  MergeSort( result + size / 2, source + size / 2, size - size / 2 );
+  cilk_sync;
+}
+
+static long sort_aggregate_keys( long *keys, long *counts, long *source, long size )
+{
+  if(size <= 0)
+  {
+    return 0;
+  }
+
+  // the halves live apart from keys, which the write pass fills while the
+  // halves are still being read
+  long *halves = malloc(sizeof(long) * size);
+  if(halves == 0)
+  {
+    printf("ERROR: Insufficient Memory; size=%ld\n", size);
+    exit(-1);
+  }
+
+  // Step 1. Sort the two halves of the final merge
+  FORK_JOIN_ROOT( sort_halves( halves, source, size ) );
+
+  // Step 2. Merge and aggregate them
+  FusedMerge_t fused;
+  fused.keys_b  = halves;
+  fused.keys_c  = halves + size / 2;
+  fused.pairs_b = NULL;
+  fused.pairs_c = NULL;
+  fused.b_size  = size / 2;
+  fused.c_size  = size - size / 2;
+  fused.op      = AGGREGATE_SUM;
+
+  long distinct = fused_merge( &fused, keys, counts );
+
+  free(halves);
+
+  return distinct;
+}
+
+long cilk_sort_unique(long *keys, long *source, long size)
+{
+  return sort_aggregate_keys( keys, NULL, source, size );
+}
+
+long cilk_sort_count(long *keys, long *counts, long *source, long size)
+{
+  return sort_aggregate_keys( keys, counts, source, size );
+}
+
+static void pack_pairs( KeyValue_t *pairs, long *keys, long *values, long size )
+{
+  if(size > PIECE_SIZE)
+  {
+    long half = size / 2;
+    cilk_spawn pack_pairs( pairs, keys, values, half );
+    pack_pairs( pairs + half, keys + half, values + half, size - half );
+    cilk_sync;
+    return;
+  }
+
+  long i;
+  for( i = 0; i < size; i++ )
+  {
+    pairs[i].key   = keys[i];
+    pairs[i].value = values[i];
+  }
+}
+
+static void kv_sort_halves( KeyValue_t *pairs, long size )
+{
+  cilk_spawn kv_merge_sort( pairs, pairs, size / 2 );
+  kv_merge_sort( pairs + size / 2, pairs + size / 2, size - size / 2 );
+  cilk_sync;
+}
+
+long cilk_sort_group_by(long *keys, long *values, long *source_keys, long *source_values, long size, Aggregate_t op)
+{
+  if(size <= 0)
+  {
+    return 0;
+  }
+
+  KeyValue_t *pairs = malloc(sizeof(KeyValue_t) * size);
+  if(pairs == 0)
+  {
+    printf("ERROR: Insufficient Memory; size=%ld\n", size);
+    exit(-1);
+  }
+
+  // Step 1. Sort the two halves of the final merge as key/value pairs
+  FORK_JOIN_ROOT( pack_pairs( pairs, source_keys, source_values, size ) );
+  FORK_JOIN_ROOT( kv_sort_halves( pairs, size ) );
+
+  // Step 2. Merge and reduce them
+  FusedMerge_t fused;
+  fused.keys_b  = NULL;
+  fused.keys_c  = NULL;
+  fused.pairs_b = pairs;
+  fused.pairs_c = pairs + size / 2;
+  fused.b_size  = size / 2;
+  fused.c_size  = size - size / 2;
+  fused.op      = op;
+
+  long distinct = fused_merge( &fused, keys, values );
+
+  free(pairs);
+
+  return distinct;
+}
@@ -0,0 +1,304 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cilk_sort.h"
+#include "fork_join.h"
+
+// Smallest array for which the distinct key estimate is taken; below it a
+// regular sort is cheaper than sampling
+#define LOWCARD_MIN_SIZE 65536
+
+// Slots of the per block hash tables; twice LOWCARD_MAX_DISTINCT keeps the
+// load factor at or below one half
+#define HASH_CAPACITY (2 * LOWCARD_MAX_DISTINCT)
+
+// Number of elements sampled to estimate the number of distinct keys
+#define SAMPLE_SIZE 1024
+
+// Elements per strand of the histogram and expansion passes; the number of
+// histogram blocks is capped so that their tables stay small
+#define BLOCK_SIZE 65536
+#define MAX_BLOCKS 64
+
+#define TRUE 1
+#define FALSE 0
+
+///////////////////////////////////////////////////////////////////////////////
+//                             Type Declarations                             //
+///////////////////////////////////////////////////////////////////////////////
+
+// Open addressing histogram of one block. A slot is empty while its count
+// is zero. overflow is set when the block holds more distinct keys than
+// LOWCARD_MAX_DISTINCT.
+typedef struct
+{
+  long keys[HASH_CAPACITY];
+  long counts[HASH_CAPACITY];
+  long distinct;
+  int overflow;
+} Histogram_t;
+
+///////////////////////////////////////////////////////////////////////////////
+//                          Function Implementation                          //
+///////////////////////////////////////////////////////////////////////////////
+
+static inline unsigned long hash_slot( long key )
+{
+  return (((unsigned long)key * 0x9E3779B97F4A7C15UL) >> 40) & (HASH_CAPACITY - 1);
+}
+
+long cilk_estimate_distinct(long *array, long size)
+{
+  if(size <= 0)
+  {
+    return 0;
+  }
+
+  long sample[SAMPLE_SIZE];
+  long sample_count = size < SAMPLE_SIZE ? size : SAMPLE_SIZE;
+  unsigned long rand_nxt = 1;
+  long i;
+
+  // pseudo random positions so periodic data does not alias the sample
+  for( i = 0; i < sample_count; i++ )
+  {
+    rand_nxt = rand_nxt * 1103515245 + 12345;
+    sample[i] = array[sample_count == size ? i : (long)((rand_nxt >> 16) % size)];
+  }
+  cilk_recursive_quicksort( sample, 0, sample_count - 1 );
+
+  // Chao1 estimator: the keys seen once or twice in the sample tell how
+  // many keys the sample is likely to have missed altogether
+  long distinct = 0;
+  long singletons = 0;
+  long doubletons = 0;
+  long run = 1;
+  for( i = 1; i <= sample_count; i++ )
+  {
+    if(i < sample_count && sample[i] == sample[i - 1])
+    {
+      run++;
+      continue;
+    }
+    distinct++;
+    if(run == 1)
+    {
+      singletons++;
+    }
+    else if(run == 2)
+    {
+      doubletons++;
+    }
+    run = 1;
+  }
+
+  double estimate = distinct + (double)singletons * (singletons - 1) / (2.0 * (doubletons + 1));
+  return estimate < size ? (long)estimate : size;
+}
+
+static void build_histograms( long *source, long size, Histogram_t *histograms, long block_size, long first_block, long last_block )
+{
+  if(last_block - first_block > 1)
+  {
+    long mid_block = first_block + (last_block - first_block) / 2;
+    cilk_spawn build_histograms( source, size, histograms, block_size, first_block, mid_block );
+    build_histograms( source, size, histograms, block_size, mid_block, last_block );
+    cilk_sync;
+    return;
+  }
+
+  Histogram_t *histogram = histograms + first_block;
+  long start = first_block * block_size;
+  long end = start + block_size < size ? start + block_size : size;
+  long i;
+
+  memset( histogram->counts, 0, sizeof(histogram->counts) );
+  histogram->distinct = 0;
+  histogram->overflow = FALSE;
+
+  for( i = start; i < end; i++ )
+  {
+    long key = source[i];
+    unsigned long slot = hash_slot( key );
+    while(histogram->counts[slot] != 0 && histogram->keys[slot] != key)
+    {
+      slot = (slot + 1) & (HASH_CAPACITY - 1);
+    }
+
+    if(histogram->counts[slot] == 0)
+    {
+      if(histogram->distinct == LOWCARD_MAX_DISTINCT)
+      {
+        histogram->overflow = TRUE;
+        return;
+      }
+      histogram->keys[slot] = key;
+      histogram->distinct++;
+    }
+    histogram->counts[slot]++;
+  }
+}
+
+// Writes output elements [first, last) given the sorted distinct keys and
+// the output offset at which the run of each key starts
+static void expand_runs( long *result, long *keys, long *offsets, long key_count, long first, long last )
+{
+  if(last - first > BLOCK_SIZE)
+  {
+    long mid = first + (last - first) / 2;
+    cilk_spawn expand_runs( result, keys, offsets, key_count, first, mid );
+    expand_runs( result, keys, offsets, key_count, mid, last );
+    cilk_sync;
+    return;
+  }
+
+  // locate the run that covers first
+  long lo = 0;
+  long hi = key_count - 1;
+  while(lo < hi)
+  {
+    long mid = lo + (hi - lo + 1) / 2;
+    if(offsets[mid] <= first)
+    {
+      lo = mid;
+    }
+    else
+    {
+      hi = mid - 1;
+    }
+  }
+
+  long i;
+  for( i = first; i < last; i++ )
+  {
+    while(offsets[lo + 1] <= i)
+    {
+      lo++;
+    }
+    result[i] = keys[lo];
+  }
+}
+
+int cilk_counting_sort(long *result, long *source, long size)
+{
+  long block_count = (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  if(block_count > MAX_BLOCKS)
+  {
+    block_count = MAX_BLOCKS;
+  }
+  if(block_count < 1)
+  {
+    return TRUE;
+  }
+  long block_size = (size + block_count - 1) / block_count;
+
+  Histogram_t *histograms = malloc(sizeof(Histogram_t) * block_count);
+  if(histograms == 0)
+  {
+    printf("ERROR: Insufficient Memory; size=%ld\n", block_count);
+    exit(-1);
+  }
+
+  // Step 1. Count every block's keys in parallel
+  FORK_JOIN_ROOT( build_histograms( source, size, histograms, block_size, 0, block_count ) );
+
+  // Step 2. Combine the blocks into one histogram, giving up when the
+  //         array turns out to hold too many distinct keys
+  Histogram_t *total = histograms;
+  int success = (total->overflow == FALSE);
+  long b, slot;
+  for( b = 1; b < block_count && success; b++ )
+  {
+    if(histograms[b].overflow == TRUE)
+    {
+      success = FALSE;
+      break;
+    }
+    for( slot = 0; slot < HASH_CAPACITY && success; slot++ )
+    {
+      if(histograms[b].counts[slot] == 0)
+      {
+        continue;
+      }
+
+      long key = histograms[b].keys[slot];
+      unsigned long target = hash_slot( key );
+      while(total->counts[target] != 0 && total->keys[target] != key)
+      {
+        target = (target + 1) & (HASH_CAPACITY - 1);
+      }
+      if(total->counts[target] == 0)
+      {
+        if(total->distinct == LOWCARD_MAX_DISTINCT)
+        {
+          success = FALSE;
+          break;
+        }
+        total->keys[target] = key;
+        total->distinct++;
+      }
+      total->counts[target] += histograms[b].counts[slot];
+    }
+  }
+
+  if(success == FALSE)
+  {
+    free(histograms);
+    return FALSE;
+  }
+
+  // Step 3. Order the distinct keys and turn their counts into run offsets
+  long key_count = total->distinct;
+  long *keys = malloc(sizeof(long) * key_count);
+  long *offsets = malloc(sizeof(long) * (key_count + 1));
+  if(keys == 0 || offsets == 0)
+  {
+    printf("ERROR: Insufficient Memory; size=%ld\n", key_count);
+    exit(-1);
+  }
+
+  long k = 0;
+  for( slot = 0; slot < HASH_CAPACITY; slot++ )
+  {
+    if(total->counts[slot] != 0)
+    {
+      keys[k++] = total->keys[slot];
+    }
+  }
+  cilk_recursive_quicksort( keys, 0, key_count - 1 );
+
+  offsets[0] = 0;
+  for( k = 0; k < key_count; k++ )
+  {
+    unsigned long target = hash_slot( keys[k] );
+    while(total->keys[target] != keys[k] || total->counts[target] == 0)
+    {
+      target = (target + 1) & (HASH_CAPACITY - 1);
+    }
+    offsets[k + 1] = offsets[k] + total->counts[target];
+  }
+
+  // Step 4. Expand the runs into the output in parallel
+  FORK_JOIN_ROOT( expand_runs( result, keys, offsets, key_count, 0, size ) );
+
+  free(offsets);
+  free(keys);
+  free(histograms);
+  return TRUE;
+}
+
+int cilk_sort_low_cardinality(long *result, long *source, long size)
+{
+  if(size < LOWCARD_MIN_SIZE)
+  {
+    return FALSE;
+  }
+
+  if(cilk_estimate_distinct(source, size) > LOWCARD_MAX_DISTINCT)
+  {
+    return FALSE;
+  }
+
+  return cilk_counting_sort( result, source, size );
+}
@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cilk_sort.h"
+#include "fork_join.h"
+
+#define TRUE 1
+#define FALSE 0
+
+///////////////////////////////////////////////////////////////////////////////
+//                          Function Implementation                          //
+///////////////////////////////////////////////////////////////////////////////
+
+void cilk_sorted_init(SortedArray_t *sorted)
+{
+  sorted->data     = NULL;
+  sorted->scratch  = NULL;
+  sorted->size     = 0;
+  sorted->capacity = 0;
+}
+
+void cilk_sorted_free(SortedArray_t *sorted)
+{
+  free(sorted->data);
+  free(sorted->scratch);
+  cilk_sorted_init( sorted );
+}
+
+int cilk_sorted_reserve(SortedArray_t *sorted, long capacity)
+{
+  if(capacity <= sorted->capacity)
+  {
+    return TRUE;
+  }
+
+  // data keeps its keys across the reallocation, scratch only ever holds
+  // the output of the merge in progress and can simply be replaced
+  long *data = realloc(sorted->data, sizeof(long) * capacity);
+  if(data == 0)
+  {
+    printf("ERROR: Insufficient Memory; size=%ld\n", capacity);
+    return FALSE;
+  }
+  sorted->data = data;
+
+  free(sorted->scratch);
+  sorted->scratch = malloc(sizeof(long) * capacity);
+  if(sorted->scratch == 0)
+  {
+    printf("ERROR: Insufficient Memory; size=%ld\n", capacity);
+    return FALSE;
+  }
+
+  sorted->capacity = capacity;
+  return TRUE;
+}
+
+int cilk_sorted_insert(SortedArray_t *sorted, long *batch, long batch_size)
+{
+  if(batch_size <= 0)
+  {
+    return TRUE;
+  }
+
+  long total = sorted->size + batch_size;
+  if(total > sorted->capacity)
+  {
+    // grow geometrically so that a stream of small batches does not
+    // reallocate on every insert
+    long capacity = sorted->capacity * 2;
+    if(capacity < total)
+    {
+      capacity = total;
+    }
+    if(!cilk_sorted_reserve(sorted, capacity))
+    {
+      return FALSE;
+    }
+  }
+
+  // Step 1. Sort the batch into the reserved tail of data
+  long *tail = sorted->data + sorted->size;
+  FORK_JOIN_ROOT( MergeSort( tail, batch, batch_size ) );
+
+  // Step 2. Merge the old keys and the sorted batch into scratch
+  FORK_JOIN_ROOT( p_merge( sorted->scratch, sorted->data, sorted->size, tail, batch_size ) );
+
+  // Step 3. The merged keys become the data; the old buffer is reused as
+  //         the scratch of the next insert
+  long *swap_buffer = sorted->data;
+  sorted->data    = sorted->scratch;
+  sorted->scratch = swap_buffer;
+  sorted->size    = total;
+
+  return TRUE;
+}
@@ -0,0 +1,445 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cilk_sort.h"
+#include "fork_join.h"
+
+// Specifies the cut-off size of the array before it switches from
+// parallel selection to a serial quickselect
+#ifndef THRESHOLD
+#define THRESHOLD 512
+#endif
+
+// Number of elements handled by one strand of the parallel count, scatter
+// and copy passes
+#define BLOCK_SIZE 16384
+
+// Number of elements sampled to choose the pivots of each selection round
+#define SAMPLE_SIZE 1024
+
+// Distance (in sample ranks) of the two pivots from the expected rank of k.
+// The band between them holds the k-th element with high probability while
+// shrinking the problem by roughly SAMPLE_SIZE / (2 * SAMPLE_GAP) per round
+#define SAMPLE_GAP 32
+
+#define TRUE 1
+#define FALSE 0
+
+///////////////////////////////////////////////////////////////////////////////
+//                          Function Implementation                          //
+///////////////////////////////////////////////////////////////////////////////
+
+static void insertion_sort( long *buffer, long size )
+{
+  long i, j, value;
+
+  for( i = 1; i < size; i++ )
+  {
+    value = buffer[i];
+    for( j = i; j > 0 && buffer[j - 1] > value; j-- )
+    {
+      buffer[j] = buffer[j - 1];
+    }
+    buffer[j] = value;
+  }
+}
+
+// Chooses the two pivots bracketing the expected position of rank k by
+// sorting an evenly spaced sample of the array
+static void select_pivots( long *array, long size, long k, long *lo, long *hi )
+{
+  long sample[SAMPLE_SIZE];
+  long sample_count = size < SAMPLE_SIZE ? size : SAMPLE_SIZE;
+  long stride = size / sample_count;
+  long i;
+
+  for( i = 0; i < sample_count; i++ )
+  {
+    sample[i] = array[i * stride];
+  }
+  insertion_sort( sample, sample_count );
+
+  long rank = (long)((double)k / size * sample_count);
+  long lo_rank = rank - SAMPLE_GAP;
+  long hi_rank = rank + SAMPLE_GAP;
+  if(lo_rank < 0)
+  {
+    lo_rank = 0;
+  }
+  if(hi_rank >= sample_count)
+  {
+    hi_rank = sample_count - 1;
+  }
+
+  *lo = sample[lo_rank];
+  *hi = sample[hi_rank];
+}
+
+// Class of value relative to the pivots: 0 below lo, 1 within [lo, hi],
+// 2 above hi
+static inline int classify( long value, long lo, long hi )
+{
+  return (value < lo) ? 0 : ((value > hi) ? 2 : 1);
+}
+
+static void select_count( long *array, long size, long lo, long hi, long *counts, long first_block, long last_block )
+{
+  if(last_block - first_block > 1)
+  {
+    long mid_block = first_block + (last_block - first_block) / 2;
+    cilk_spawn select_count( array, size, lo, hi, counts, first_block, mid_block );
+    select_count( array, size, lo, hi, counts, mid_block, last_block );
+    cilk_sync;
+    return;
+  }
+
+  long start = first_block * BLOCK_SIZE;
+  long end = start + BLOCK_SIZE < size ? start + BLOCK_SIZE : size;
+  long *block_counts = counts + first_block * 3;
+  long i;
+
+  block_counts[0] = block_counts[1] = block_counts[2] = 0;
+  for( i = start; i < end; i++ )
+  {
+    block_counts[classify(array[i], lo, hi)]++;
+  }
+}
+
+static void select_scatter( long *dest, long *array, long size, long lo, long hi, long *offsets, long first_block, long last_block )
+{
+  if(last_block - first_block > 1)
+  {
+    long mid_block = first_block + (last_block - first_block) / 2;
+    cilk_spawn select_scatter( dest, array, size, lo, hi, offsets, first_block, mid_block );
+    select_scatter( dest, array, size, lo, hi, offsets, mid_block, last_block );
+    cilk_sync;
+    return;
+  }
+
+  long start = first_block * BLOCK_SIZE;
+  long end = start + BLOCK_SIZE < size ? start + BLOCK_SIZE : size;
+  long *block_offsets = offsets + first_block * 3;
+  long i;
+
+  for( i = start; i < end; i++ )
+  {
+    dest[block_offsets[classify(array[i], lo, hi)]++] = array[i];
+  }
+}
+
+static void parallel_copy( long *dest, long *source, long size )
+{
+  if(size > BLOCK_SIZE)
+  {
+    long half = size / 2;
+    cilk_spawn parallel_copy( dest, source, half );
+    parallel_copy( dest + half, source + half, size - half );
+    cilk_sync;
+  }
+  else
+  {
+    memcpy( dest, source, sizeof(long) * size );
+  }
+}
+
+// Stably partitions array into the values below lo, within [lo, hi] and above
+// hi, using scratch as the staging buffer. Returns the size of the first two
+// classes through n_below and n_within.
+static void partition_three_way( long *array, long *scratch, long size, long lo, long hi, long *n_below, long *n_within )
+{
+  long block_count = (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  long *counts = malloc(sizeof(long) * 3 * block_count);
+  if(counts == 0)
+  {
+    printf("ERROR: Insufficient Memory; size=%ld\n", block_count);
+    exit(-1);
+  }
+
+  FORK_JOIN_ROOT( select_count( array, size, lo, hi, counts, 0, block_count ) );
+
+  // turn the per block counts into per block write offsets
+  long totals[3] = { 0, 0, 0 };
+  long b, c;
+  for( b = 0; b < block_count; b++ )
+  {
+    for( c = 0; c < 3; c++ )
+    {
+      totals[c] += counts[b * 3 + c];
+    }
+  }
+
+  long base[3] = { 0, totals[0], totals[0] + totals[1] };
+  for( b = 0; b < block_count; b++ )
+  {
+    for( c = 0; c < 3; c++ )
+    {
+      long count = counts[b * 3 + c];
+      counts[b * 3 + c] = base[c];
+      base[c] += count;
+    }
+  }
+
+  FORK_JOIN_ROOT( select_scatter( scratch, array, size, lo, hi, counts, 0, block_count ) );
+  FORK_JOIN_ROOT( parallel_copy( array, scratch, size ) );
+
+  free(counts);
+
+  *n_below  = totals[0];
+  *n_within = totals[1];
+}
+
+static void serial_select( long *array, long size, long k )
+{
+  long start = 0;
+  long end = size - 1;
+
+  while(start < end)
+  {
+    long mid = cilk_partition( array, start, end );
+    if(mid == k)
+    {
+      return;
+    }
+    else if(k < mid)
+    {
+      end = mid - 1;
+    }
+    else
+    {
+      start = mid + 1;
+    }
+  }
+}
+
+void cilk_nth_element(long *array, long size, long k)
+{
+  if(k < 0 || k >= size)
+  {
+    return;
+  }
+
+  long *scratch = NULL;
+  if(size > THRESHOLD)
+  {
+    scratch = malloc(sizeof(long) * size);
+    if(scratch == 0)
+    {
+      printf("ERROR: Insufficient Memory; size=%ld\n", size);
+      exit(-1);
+    }
+  }
+
+  // Each round narrows [array, array + size) to the class that holds rank k.
+  // When a round fails to shrink the problem (e.g. every value lies between
+  // two pivots drawn from a low cardinality array) the next round uses a
+  // single pivot, whose middle class then holds only duplicates of it.
+  int single_pivot = FALSE;
+  while(size > THRESHOLD)
+  {
+    long lo, hi, n_below, n_within;
+    select_pivots( array, size, k, &lo, &hi );
+    if(single_pivot == TRUE)
+    {
+      hi = lo;
+    }
+
+    partition_three_way( array, scratch, size, lo, hi, &n_below, &n_within );
+
+    if(k < n_below)
+    {
+      size = n_below;
+      single_pivot = FALSE;
+    }
+    else if(k < n_below + n_within)
+    {
+      if(lo == hi)
+      {
+        // everything in the middle class equals the pivot
+        size = 0;
+      }
+      else if(n_within == size)
+      {
+        single_pivot = TRUE;
+      }
+      else
+      {
+        array += n_below;
+        k     -= n_below;
+        size   = n_within;
+        single_pivot = FALSE;
+      }
+    }
+    else
+    {
+      array += n_below + n_within;
+      k     -= n_below + n_within;
+      size  -= n_below + n_within;
+      single_pivot = FALSE;
+    }
+  }
+
+  if(size > 0)
+  {
+    serial_select( array, size, k );
+  }
+
+  free(scratch);
+}
+
+void cilk_partial_sort(long *array, long size, long k)
+{
+  if(k <= 0)
+  {
+    return;
+  }
+  if(k > size)
+  {
+    k = size;
+  }
+
+  if(k < size)
+  {
+    cilk_nth_element( array, size, k - 1 );
+  }
+
+  long *sorted = malloc(sizeof(long) * k);
+  if(sorted == 0)
+  {
+    printf("ERROR: Insufficient Memory; size=%ld\n", k);
+    exit(-1);
+  }
+
+  FORK_JOIN_ROOT( MergeSort( sorted, array, k ) );
+  FORK_JOIN_ROOT( parallel_copy( array, sorted, k ) );
+
+  free(sorted);
+}
+
+long *cilk_top_k(long *array, long size, long k)
+{
+  if(k > size)
+  {
+    k = size;
+  }
+  if(k < 0)
+  {
+    k = 0;
+  }
+
+  long *work = malloc(sizeof(long) * (size > 0 ? size : 1));
+  if(work == 0)
+  {
+    printf("Insufficient Memory\n");
+    exit(-1);
+  }
+
+  FORK_JOIN_ROOT( parallel_copy( work, array, size ) );
+  cilk_partial_sort( work, size, k );
+
+  // release the tail that no longer holds any of the k smallest values
+  long *result = realloc(work, sizeof(long) * (k > 0 ? k : 1));
+  return result ? result : work;
+}
+
+// Resolves the queries order[first..last), which are sorted by rank, against
+// array whose first element has global rank base
+static void select_ranks_recursive( long *array, long size, long base, const long *ranks, const long *order, long first, long last, long *values )
+{
+  if(first >= last)
+  {
+    return;
+  }
+
+  long mid = first + (last - first) / 2;
+  long k = ranks[order[mid]] - base;
+  cilk_nth_element( array, size, k );
+
+  // queries asking for the same rank are all answered by this round
+  long lo = mid;
+  long hi = mid + 1;
+  while(lo > first && ranks[order[lo - 1]] == ranks[order[mid]])
+  {
+    lo--;
+  }
+  while(hi < last && ranks[order[hi]] == ranks[order[mid]])
+  {
+    hi++;
+  }
+
+  long i;
+  for( i = lo; i < hi; i++ )
+  {
+    values[order[i]] = array[k];
+  }
+
+  // the two sides of array[k] are now independent subproblems
+  cilk_spawn select_ranks_recursive( array, k, base, ranks, order, first, lo, values );
+  select_ranks_recursive( array + k + 1, size - k - 1, base + k + 1, ranks, order, hi, last, values );
+  cilk_sync;
+}
+
+void cilk_select_ranks(long *array, long size, const long *ranks, long count, long *values)
+{
+  long *order = malloc(sizeof(long) * (count > 0 ? count : 1));
+  if(order == 0)
+  {
+    printf("Insufficient Memory\n");
+    exit(-1);
+  }
+
+  // order the queries by rank, dropping the ones outside the array
+  long valid = 0;
+  long i, j;
+  for( i = 0; i < count; i++ )
+  {
+    if(ranks[i] < 0 || ranks[i] >= size)
+    {
+      continue;
+    }
+    for( j = valid; j > 0 && ranks[order[j - 1]] > ranks[i]; j-- )
+    {
+      order[j] = order[j - 1];
+    }
+    order[j] = i;
+    valid++;
+  }
+
+  FORK_JOIN_ROOT( select_ranks_recursive( array, size, 0, ranks, order, 0, valid, values ) );
+
+  free(order);
+}
+
+void cilk_percentiles(long *array, long size, const double *percents, long count, long *values)
+{
+  if(size <= 0)
+  {
+    return;
+  }
+
+  long *ranks = malloc(sizeof(long) * (count > 0 ? count : 1));
+  if(ranks == 0)
+  {
+    printf("Insufficient Memory\n");
+    exit(-1);
+  }
+
+  long i;
+  for( i = 0; i < count; i++ )
+  {
+    double percent = percents[i];
+    if(percent < 0.0)
+    {
+      percent = 0.0;
+    }
+    if(percent > 100.0)
+    {
+      percent = 100.0;
+    }
+    ranks[i] = (long)(percent / 100.0 * (size - 1));
+  }
+
+  cilk_select_ranks( array, size, ranks, count, values );
+
+  free(ranks);
+}
@@ -0,0 +1,427 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cilk_sort.h"
+#include "fork_join.h"
+
+// Approximate number of positions of the merged inputs handled by one strand
+#define PIECE_SIZE 16384
+
+// Smallest number of join pairs one strand writes; a piece whose output is
+// larger (a hot value) is written in chunks of at least this many pairs
+#define JOIN_CHUNK (4 * PIECE_SIZE)
+
+#define TRUE 1
+#define FALSE 0
+
+typedef enum
+{
+  SET_UNION,
+  SET_INTERSECTION,
+  SET_DIFFERENCE,
+  SET_JOIN
+} SetOperation_t;
+
+// Slices of the two inputs that one strand combines; count is the size of
+// its output and offset where that output starts
+typedef struct
+{
+  MergeSlice_t slice;
+  long count;
+  long offset;
+} SetPiece_t;
+
+// State of one set operation. result receives the values, or b_index and
+// c_index the index pairs of a join; all three are NULL during the count pass.
+typedef struct
+{
+  SetOperation_t op;
+  long *array_b;
+  long b_size;
+  long *array_c;
+  long c_size;
+  long *result;
+  long *b_index;
+  long *c_index;
+  SetPiece_t *pieces;
+  long piece_count;
+} SetJob_t;
+
+///////////////////////////////////////////////////////////////////////////////
+//                          Function Implementation                          //
+///////////////////////////////////////////////////////////////////////////////
+
+// Serial kernels. Each combines one slice of B and C, writes its output to
+// result (skipped when result is NULL) and returns the output size, with
+// std::set_* multiset semantics: a value held m times in B and n times in C
+// appears max(m, n) times in the union, min(m, n) times in the intersection
+// and max(m - n, 0) times in the difference.
+
+static long s_union( long *result, long *array_b, long b_size, long *array_c, long c_size )
+{
+  long count = 0;
+
+  while( b_size > 0 && c_size > 0 )
+  {
+    long value;
+    if(*array_b < *array_c)
+    {
+      value = *array_b++; b_size--;
+    }
+    else if(*array_c < *array_b)
+    {
+      value = *array_c++; c_size--;
+    }
+    else
+    {
+      value = *array_b++; b_size--;
+      array_c++; c_size--;
+    }
+
+    if(result)
+    {
+      result[count] = value;
+    }
+    count++;
+  }
+
+  if(result)
+  {
+    memcpy( result + count, array_b, sizeof(long) * b_size );
+    memcpy( result + count + b_size, array_c, sizeof(long) * c_size );
+  }
+
+  return count + b_size + c_size;
+}
+
+static long s_intersection( long *result, long *array_b, long b_size, long *array_c, long c_size )
+{
+  long count = 0;
+
+  while( b_size > 0 && c_size > 0 )
+  {
+    if(*array_b < *array_c)
+    {
+      array_b++; b_size--;
+    }
+    else if(*array_c < *array_b)
+    {
+      array_c++; c_size--;
+    }
+    else
+    {
+      if(result)
+      {
+        result[count] = *array_b;
+      }
+      count++;
+      array_b++; b_size--;
+      array_c++; c_size--;
+    }
+  }
+
+  return count;
+}
+
+static long s_difference( long *result, long *array_b, long b_size, long *array_c, long c_size )
+{
+  long count = 0;
+
+  while( b_size > 0 && c_size > 0 )
+  {
+    if(*array_b < *array_c)
+    {
+      if(result)
+      {
+        result[count] = *array_b;
+      }
+      count++;
+      array_b++; b_size--;
+    }
+    else if(*array_c < *array_b)
+    {
+      array_c++; c_size--;
+    }
+    else
+    {
+      array_b++; b_size--;
+      array_c++; c_size--;
+    }
+  }
+
+  if(result)
+  {
+    memcpy( result + count, array_b, sizeof(long) * b_size );
+  }
+
+  return count + b_size;
+}
+
+// Enumerates the pairs (i + b_base, j + c_base) for every i, j with
+// array_b[i] == array_c[j], ordered by value, then i, then j, and writes
+// those numbered [first, last) to b_index and c_index (skipped when NULL).
+// Returns the number of pairs.
+static long s_join( long *b_index, long *c_index, long first, long last, long *array_b, long b_size, long b_base, long *array_c, long c_size, long c_base )
+{
+  long count = 0;
+  long i = 0;
+  long j = 0;
+
+  while( i < b_size && j < c_size )
+  {
+    if(array_b[i] < array_c[j])
+    {
+      i++;
+    }
+    else if(array_c[j] < array_b[i])
+    {
+      j++;
+    }
+    else
+    {
+      // cross product of the two runs of the value
+      long value = array_b[i];
+      long b_end = i;
+      long c_end = j;
+      while(b_end < b_size && array_b[b_end] == value)
+      {
+        b_end++;
+      }
+      while(c_end < c_size && array_c[c_end] == value)
+      {
+        c_end++;
+      }
+
+      long run = (b_end - i) * (c_end - j);
+      if(b_index && count + run > first)
+      {
+        // pair r of the run is (i + r / c_run, j + r % c_run)
+        long r = first > count ? first - count : 0;
+        long r_end = last - count < run ? last - count : run;
+        long bi = i + r / (c_end - j);
+        long cj = j + r % (c_end - j);
+        for( ; r < r_end; r++ )
+        {
+          b_index[count + r - first] = bi + b_base;
+          c_index[count + r - first] = cj + c_base;
+          if(++cj == c_end)
+          {
+            cj = j;
+            bi++;
+          }
+        }
+      }
+      count += run;
+
+      if(b_index && count >= last)
+      {
+        break;
+      }
+
+      i = b_end;
+      j = c_end;
+    }
+  }
+
+  return count;
+}
+
+// Cuts the inputs at evenly spaced positions of their merge, so every piece
+// gets a similar share of both inputs however their values interleave. The
+// cuts fall on run boundaries, which keeps every run of equal values inside
+// a single piece, so the pieces are independent under multiset semantics.
+static void split_pieces( SetJob_t *job, long first_piece, long last_piece )
+{
+  if(last_piece - first_piece > 1)
+  {
+    long mid_piece = first_piece + (last_piece - first_piece) / 2;
+    cilk_spawn split_pieces( job, first_piece, mid_piece );
+    split_pieces( job, mid_piece, last_piece );
+    cilk_sync;
+    return;
+  }
+
+  long total = job->b_size + job->c_size;
+
+  merge_slice( &job->pieces[first_piece].slice,
+               first_piece * total / job->piece_count,
+               (first_piece + 1) * total / job->piece_count,
+               job->array_b, job->b_size, job->array_c, job->c_size, TRUE );
+}
+
+// Writes the join pairs [first, last) of a piece. Every chunk rescans the
+// whole slice, so a piece whose output dwarfs its input (a hot value) is
+// split into chunks no smaller than the slice, keeping the rescans cheaper
+// than the writes.
+static void join_chunks( SetJob_t *job, SetPiece_t *piece, long first, long last )
+{
+  long b_size = piece->slice.b_last - piece->slice.b_first;
+  long c_size = piece->slice.c_last - piece->slice.c_first;
+  long chunk = b_size + c_size > JOIN_CHUNK ? b_size + c_size : JOIN_CHUNK;
+
+  if(last - first > chunk)
+  {
+    long mid = first + (last - first) / 2;
+    cilk_spawn join_chunks( job, piece, first, mid );
+    join_chunks( job, piece, mid, last );
+    cilk_sync;
+    return;
+  }
+
+  s_join( job->b_index + piece->offset + first, job->c_index + piece->offset + first, first, last,
+          job->array_b + piece->slice.b_first, b_size, piece->slice.b_first,
+          job->array_c + piece->slice.c_first, c_size, piece->slice.c_first );
+}
+
+// Runs the operation on every piece; the count pass (NULL outputs) records
+// the output sizes, the write pass stores each piece at its offset
+static void run_pieces( SetJob_t *job, long first_piece, long last_piece )
+{
+  if(last_piece - first_piece > 1)
+  {
+    long mid_piece = first_piece + (last_piece - first_piece) / 2;
+    cilk_spawn run_pieces( job, first_piece, mid_piece );
+    run_pieces( job, mid_piece, last_piece );
+    cilk_sync;
+    return;
+  }
+
+  SetPiece_t *piece = &job->pieces[first_piece];
+  long *array_b = job->array_b + piece->slice.b_first;
+  long *array_c = job->array_c + piece->slice.c_first;
+  long b_size = piece->slice.b_last - piece->slice.b_first;
+  long c_size = piece->slice.c_last - piece->slice.c_first;
+  long *result = job->result ? job->result + piece->offset : NULL;
+  long count = 0;
+
+  switch(job->op)
+  {
+  case SET_UNION:
+    count = s_union( result, array_b, b_size, array_c, c_size );
+    break;
+  case SET_INTERSECTION:
+    count = s_intersection( result, array_b, b_size, array_c, c_size );
+    break;
+  case SET_DIFFERENCE:
+    count = s_difference( result, array_b, b_size, array_c, c_size );
+    break;
+  case SET_JOIN:
+    if(job->b_index)
+    {
+      join_chunks( job, piece, 0, piece->count );
+      return;
+    }
+    count = s_join( NULL, NULL, 0, 0, array_b, b_size, piece->slice.b_first, array_c, c_size, piece->slice.c_first );
+    break;
+  }
+
+  piece->count = count;
+}
+
+// Splits the inputs and counts the output of every piece; returns the
+// total output size
+static long prepare_job( SetJob_t *job )
+{
+  job->piece_count = (job->b_size + job->c_size + PIECE_SIZE - 1) / PIECE_SIZE;
+  if(job->piece_count < 1)
+  {
+    job->piece_count = 1;
+  }
+
+  job->pieces = malloc(sizeof(SetPiece_t) * job->piece_count);
+  if(job->pieces == 0)
+  {
+    printf("ERROR: Insufficient Memory; size=%ld\n", job->piece_count);
+    exit(-1);
+  }
+
+  // Step 1. Cut the inputs into independent pieces
+  FORK_JOIN_ROOT( split_pieces( job, 0, job->piece_count ) );
+
+  // Step 2. Count the output of every piece
+  FORK_JOIN_ROOT( run_pieces( job, 0, job->piece_count ) );
+
+  // Step 3. Turn the counts into output offsets
+  long total = 0;
+  long p;
+  for( p = 0; p < job->piece_count; p++ )
+  {
+    job->pieces[p].offset = total;
+    total += job->pieces[p].count;
+  }
+
+  return total;
+}
+
+static long set_operation( SetOperation_t op, long *result, long *array_b, long b_size, long *array_c, long c_size )
+{
+  SetJob_t job;
+  job.op      = op;
+  job.array_b = array_b;
+  job.b_size  = b_size;
+  job.array_c = array_c;
+  job.c_size  = c_size;
+  job.result  = NULL;
+  job.b_index = NULL;
+  job.c_index = NULL;
+
+  long total = prepare_job( &job );
+
+  // Step 4. Write every piece at its offset
+  job.result = result;
+  FORK_JOIN_ROOT( run_pieces( &job, 0, job.piece_count ) );
+
+  free(job.pieces);
+
+  return total;
+}
+
+long cilk_set_union(long *result, long *array_b, long b_size, long *array_c, long c_size)
+{
+  return set_operation( SET_UNION, result, array_b, b_size, array_c, c_size );
+}
+
+long cilk_set_intersection(long *result, long *array_b, long b_size, long *array_c, long c_size)
+{
+  return set_operation( SET_INTERSECTION, result, array_b, b_size, array_c, c_size );
+}
+
+long cilk_set_difference(long *result, long *array_b, long b_size, long *array_c, long c_size)
+{
+  return set_operation( SET_DIFFERENCE, result, array_b, b_size, array_c, c_size );
+}
+
+long cilk_merge_join(long *array_b, long b_size, long *array_c, long c_size, long **b_index, long **c_index)
+{
+  SetJob_t job;
+  job.op      = SET_JOIN;
+  job.array_b = array_b;
+  job.b_size  = b_size;
+  job.array_c = array_c;
+  job.c_size  = c_size;
+  job.result  = NULL;
+  job.b_index = NULL;
+  job.c_index = NULL;
+
+  long total = prepare_job( &job );
+
+  // the count pass sized the output exactly
+  job.b_index = malloc(sizeof(long) * (total > 0 ? total : 1));
+  job.c_index = malloc(sizeof(long) * (total > 0 ? total : 1));
+  if(job.b_index == 0 || job.c_index == 0)
+  {
+    printf("ERROR: Insufficient Memory; size=%ld\n", total);
+    exit(-1);
+  }
+
+  // Step 4. Write every piece at its offset
+  FORK_JOIN_ROOT( run_pieces( &job, 0, job.piece_count ) );
+
+  free(job.pieces);
+
+  *b_index = job.b_index;
+  *c_index = job.c_index;
+
+  return total;
+}
@@ -1,12 +1,15 @@
-#include <cilk/cilk.h>
-
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "cilk_sort.h"
+#include "fork_join.h"
+
 // Specifies the cut-off size of the array before it switches from
 // parallel merges/sorts to a serial implementation
+#ifndef THRESHOLD
 #define THRESHOLD 512
+#endif
 
 ///////////////////////////////////////////////////////////////////////////////
 //                          Function Implementation                          //
@@ -98,6 +101,11 @@ void p_merge( long *result, long *array_b, long b_size, long *array_c, long c_si
     // perform sequential merge rather than parallel
     s_merge( result, array_b, b_size, array_c, c_size );
   }
+  else if( c_size == 0 )
+  {
+    // nothing to interleave; binary_search below needs a non-empty C
+    memcpy( result, array_b, sizeof(long) * b_size );
+  }
   else
   {
     long mid_index = b_size / 2;
@@ -147,6 +155,45 @@ long cilk_partition( long *buffer, long start, long end )
   return i + 1;
 }
 
+// Three-way (Dutch national flag) partition around buffer[end]. On return
+// [start, *lt) < pivot, [*lt, *gt] == pivot and (*gt, end] > pivot, so runs
+// of duplicates are excluded from both recursive calls.
+void cilk_partition3( long *buffer, long start, long end, long *lt, long *gt )
+{
+
+  long temp = 0;
+
+  long pivot = buffer[end];
+  long lo = start;
+  long hi = end;
+  long i = start;
+  while( i <= hi )
+  {
+    if(buffer[i] < pivot)
+    {
+      temp = buffer[lo];
+      buffer[lo] = buffer[i];
+      buffer[i] = temp;
+      lo++;
+      i++;
+    }
+    else if(buffer[i] > pivot)
+    {
+      temp = buffer[hi];
+      buffer[hi] = buffer[i];
+      buffer[i] = temp;
+      hi--;
+    }
+    else
+    {
+      i++;
+    }
+  }
+
+  *lt = lo;
+  *gt = hi;
+}
+
 void cilk_recursive_quicksort( long *buffer, long start, long end )
 {
   if(start >= end)
@@ -154,9 +201,10 @@ void cilk_recursive_quicksort( long *buffer, long start, long end )
     return;
   }
 
-  long mid = cilk_partition( buffer, start, end );
-  cilk_recursive_quicksort( buffer, start, mid - 1 );
-  cilk_recursive_quicksort( buffer, mid + 1, end );
+  long lt, gt;
+  cilk_partition3( buffer, start, end, &lt, &gt );
+  cilk_recursive_quicksort( buffer, start, lt - 1 );
+  cilk_recursive_quicksort( buffer, gt + 1, end );
 }
 
 void cilk_quicksort( long *result, long *source, long size )
@@ -164,10 +212,96 @@ void cilk_quicksort( long *result, long *source, long size )
   // the following sort algorithm will perform an in place
   // sorting of the data so it needs to be copied to the
   // destination buffer so that they sorting can be performed
-  memcpy( result, source, sizeof(long) * size);
+  if(result != source)
+  {
+    memcpy( result, source, sizeof(long) * size);
+  }
   cilk_recursive_quicksort( result, 0, size - 1 );
 }
 
+// Number of elements of B among the first k elements of the merge of B and
+// C, where ties are taken from B first (as s_merge does)
+long co_rank( long k, long *array_b, long b_size, long *array_c, long c_size )
+{
+  long lo = k > c_size ? k - c_size : 0;
+  long hi = k < b_size ? k : b_size;
+
+  while(lo < hi)
+  {
+    long i = lo + (hi - lo) / 2;
+    if(array_b[i] <= array_c[k - i - 1])
+    {
+      lo = i + 1;
+    }
+    else
+    {
+      hi = i;
+    }
+  }
+
+  return lo;
+}
+
+// Number of elements of search_array that are smaller than value (unlike
+// binary_search, which places values equal to the last element after it)
+long lower_bound( long *search_array, long array_size, long value )
+{
+  long min = 0;
+  long max = array_size;
+
+  while(min < max)
+  {
+    long mid = min + (max - min) / 2;
+    if(search_array[mid] < value)
+    {
+      min = mid + 1;
+    }
+    else
+    {
+      max = mid;
+    }
+  }
+
+  return min;
+}
+
+// Cuts B and C at position k of their merge. With whole_runs set both cuts
+// move down to the lower bound of the value found at k, so no run of equal
+// values straddles the cut (the cut may then fall before k).
+static void merge_cut( long k, long *array_b, long b_size, long *array_c, long c_size, int whole_runs, long *b_cut, long *c_cut )
+{
+  if(k <= 0 || k >= b_size + c_size)
+  {
+    *b_cut = k <= 0 ? 0 : b_size;
+    *c_cut = k <= 0 ? 0 : c_size;
+    return;
+  }
+
+  long b = co_rank( k, array_b, b_size, array_c, c_size );
+  long c = k - b;
+  if(!whole_runs)
+  {
+    *b_cut = b;
+    *c_cut = c;
+    return;
+  }
+
+  long value = (c >= c_size || (b < b_size && array_b[b] <= array_c[c]))
+               ? array_b[b] : array_c[c];
+
+  *b_cut = lower_bound( array_b, b_size, value );
+  *c_cut = lower_bound( array_c, c_size, value );
+}
+
+// Slices of B and C that hold positions [first, last) of their merge, cut
+// at exact co-ranks or, with whole_runs set, at run boundaries. Pieces of a
+// merge-based operator cut this way at shared positions tile both arrays.
+void merge_slice( MergeSlice_t *slice, long first, long last, long *array_b, long b_size, long *array_c, long c_size, int whole_runs )
+{
+  merge_cut( first, array_b, b_size, array_c, c_size, whole_runs, &slice->b_first, &slice->c_first );
+  merge_cut( last, array_b, b_size, array_c, c_size, whole_runs, &slice->b_last, &slice->c_last );
+}
+
 void MergeSort( long *result, long *source, long size ){
 
   if(size <= THRESHOLD )
@@ -210,8 +344,23 @@ long *cilk_sort(long *array, long size) {
     exit(-1);
   }
 
-  MergeSort( result, array, size );
+  cilk_sort_into( result, array, size );
   
   return result;
 }
 
+void cilk_sort_into(long *result, long *source, long size)
+{
+  // arrays with few distinct keys are counted rather than merged
+  if(cilk_sort_low_cardinality( result, source, size ))
+  {
+    return;
+  }
+
+  FORK_JOIN_ROOT( MergeSort( result, source, size ) );
+}
+
+void cilk_merge(long *result, long *array_b, long b_size, long *array_c, long c_size)
+{
+  FORK_JOIN_ROOT( p_merge( result, array_b, b_size, array_c, c_size ) );
+}
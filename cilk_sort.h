@@ -0,0 +1,156 @@
+#ifndef _CILK_SORT_H_
+#define _CILK_SORT_H_
+
+///////////////////////////////////////////////////////////////////////////////
+//                               Sorting                                     //
+///////////////////////////////////////////////////////////////////////////////
+
+// Sorts array into a newly allocated buffer
+long *cilk_sort(long *array, long size);
+
+// Sorts source into result, which may be source itself for an in place sort
+void cilk_sort_into(long *result, long *source, long size);
+
+// Cache-aware variants: L2 sized tiles are sorted to completion before being
+// merged upwards, and the last merge pass writes with non-temporal stores
+long *cilk_sort_cache_aware(long *array, long size);
+void cilk_sort_cache_aware_into(long *result, long *source, long size);
+
+// Low cardinality path: estimates the number of distinct keys from a sample
+// and, when it is small, sorts with a parallel hash histogram followed by a
+// parallel expansion of the per key runs in O(n) work. Returns FALSE (and
+// leaves result untouched) when the array has too many distinct keys.
+// Largest number of distinct keys handled by the histogram path
+#define LOWCARD_MAX_DISTINCT 2048
+
+int cilk_sort_low_cardinality(long *result, long *source, long size);
+int cilk_counting_sort(long *result, long *source, long size);
+
+// Estimated number of distinct keys of array, from a sample
+long cilk_estimate_distinct(long *array, long size);
+
+///////////////////////////////////////////////////////////////////////////////
+//                               Merging                                     //
+///////////////////////////////////////////////////////////////////////////////
+
+// Merges the sorted arrays B and C into result (which must not overlap them)
+void cilk_merge(long *result, long *array_b, long b_size, long *array_c, long c_size);
+
+// Sorted array that absorbs batches of new keys. data holds size sorted keys
+// and has room for capacity; scratch is the equally sized buffer the next
+// merge is written into before the two are swapped.
+typedef struct
+{
+  long *data;
+  long *scratch;
+  long size;
+  long capacity;
+} SortedArray_t;
+
+void cilk_sorted_init(SortedArray_t *sorted);
+void cilk_sorted_free(SortedArray_t *sorted);
+
+// Reserves room for capacity keys so that later inserts do not reallocate
+int cilk_sorted_reserve(SortedArray_t *sorted, long capacity);
+
+// Sorts batch and merges it into sorted; costs O(size + batch_size) for the
+// merge plus O(batch_size log batch_size) for sorting the batch
+int cilk_sorted_insert(SortedArray_t *sorted, long *batch, long batch_size);
+
+///////////////////////////////////////////////////////////////////////////////
+//                            Set operations                                 //
+///////////////////////////////////////////////////////////////////////////////
+
+// Operations on the sorted arrays B and C with multiset semantics, as the
+// std::set_* algorithms: a value held m times in B and n times in C appears
+// max(m, n) times in the union, min(m, n) times in the intersection and
+// max(m - n, 0) times in B minus C. result must have room for b_size +
+// c_size, min(b_size, c_size) and b_size entries respectively. Each returns
+// the number of entries written.
+long cilk_set_union(long *result, long *array_b, long b_size, long *array_c, long c_size);
+long cilk_set_intersection(long *result, long *array_b, long b_size, long *array_c, long c_size);
+long cilk_set_difference(long *result, long *array_b, long b_size, long *array_c, long c_size);
+
+// Equi-join of the sorted arrays B and C: returns the number of pairs (i, j)
+// with array_b[i] == array_c[j] and stores them, ordered by value, i and j,
+// into the newly allocated arrays *b_index and *c_index
+long cilk_merge_join(long *array_b, long b_size, long *array_c, long c_size, long **b_index, long **c_index);
+
+///////////////////////////////////////////////////////////////////////////////
+//                              Selection                                    //
+///////////////////////////////////////////////////////////////////////////////
+
+// Rearranges array so that array[k] holds the value it would have if the
+// array were sorted, everything before it is <= and everything after it >=
+void cilk_nth_element(long *array, long size, long k);
+
+// Rearranges array so that its first k entries are its k smallest values in
+// sorted order; the order of the remaining entries is unspecified
+void cilk_partial_sort(long *array, long size, long k);
+
+// Returns a newly allocated, sorted copy of the k smallest values of array;
+// array itself is left untouched
+long *cilk_top_k(long *array, long size, long k);
+
+// Stores into values[i] the element of rank ranks[i] (0 based); array is
+// rearranged in the process
+void cilk_select_ranks(long *array, long size, const long *ranks, long count, long *values);
+
+// Stores into values[i] the percents[i]-th percentile (0..100, lower nearest
+// rank) of array; array is rearranged in the process
+void cilk_percentiles(long *array, long size, const double *percents, long count, long *values);
+
+///////////////////////////////////////////////////////////////////////////////
+//                             Aggregation                                   //
+///////////////////////////////////////////////////////////////////////////////
+
+// The operators below sort their input and aggregate equal keys inside the
+// final merge, so the sorted, uncompacted array is never written out. The
+// output arrays must have room for size entries; source arrays may be the
+// output arrays themselves. Each returns the number of distinct keys.
+
+// Reduction applied to the values of equal keys by cilk_sort_group_by
+typedef enum
+{
+  AGGREGATE_SUM,
+  AGGREGATE_MIN,
+  AGGREGATE_MAX
+} Aggregate_t;
+
+// Sorted distinct keys of source
+long cilk_sort_unique(long *keys, long *source, long size);
+
+// Sorted distinct keys of source and the number of occurrences of each
+long cilk_sort_count(long *keys, long *counts, long *source, long size);
+
+// Sorted distinct keys of the (source_keys[i], source_values[i]) pairs and
+// the values of each key reduced by op
+long cilk_sort_group_by(long *keys, long *values, long *source_keys, long *source_values, long size, Aggregate_t op);
+
+///////////////////////////////////////////////////////////////////////////////
+//                  Kernels shared by the cilk_*.c files                     //
+///////////////////////////////////////////////////////////////////////////////
+long binary_search( long *search_array, long array_size, long value );
+void s_merge( long *result, long *array_b, long b_size, long *array_c, long c_size );
+long cilk_partition( long *buffer, long start, long end );
+void cilk_partition3( long *buffer, long start, long end, long *lt, long *gt );
+void cilk_recursive_quicksort( long *buffer, long start, long end );
+void cilk_quicksort( long *result, long *source, long size );
+void p_merge( long *result, long *array_b, long b_size, long *array_c, long c_size );
+long co_rank( long k, long *array_b, long b_size, long *array_c, long c_size );
+long lower_bound( long *search_array, long array_size, long value );
+
+// Slices [b_first, b_last) and [c_first, c_last) of two sorted arrays that
+// hold one range of positions of their merge
+typedef struct
+{
+  long b_first;
+  long b_last;
+  long c_first;
+  long c_last;
+} MergeSlice_t;
+
+void merge_slice( MergeSlice_t *slice, long first, long last, long *array_b, long b_size, long *array_c, long c_size, int whole_runs );
+void MergeSort( long *result, long *source, long size );
+
+#endif  // _CILK_SORT_H_
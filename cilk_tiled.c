@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) && defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "cilk_sort.h"
+#include "fork_join.h"
+
+// Specifies the cut-off size of the array before it switches from
+// parallel merges/sorts to a serial implementation
+#ifndef THRESHOLD
+#define THRESHOLD 512
+#endif
+
+// Cut-off of the final, non-temporal merge pass. It is larger than THRESHOLD
+// so every serial leaf streams long runs through the write combining buffers.
+#define NT_THRESHOLD 8192
+
+// Number of elements ahead of the read position that the final merge pass
+// prefetches on both input streams
+#define PREFETCH_DISTANCE 64
+
+// L2 size assumed when the system does not report one
+#define DEFAULT_L2_BYTES (256 * 1024)
+
+#if defined(__x86_64__) && defined(__SSE2__)
+#define STREAM_STORE(dest, value) _mm_stream_si64( (long long *)(dest), (long long)(value) )
+#define STREAM_FENCE() _mm_sfence()
+#else
+#define STREAM_STORE(dest, value) (*(dest) = (value))
+#define STREAM_FENCE()
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+//                          Function Implementation                          //
+///////////////////////////////////////////////////////////////////////////////
+
+// Number of elements in one tile: a tile, its output and its scratch space
+// together fit in L2
+static long tile_elements( void )
+{
+  long l2_bytes = -1;
+#ifdef _SC_LEVEL2_CACHE_SIZE
+  l2_bytes = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+  if(l2_bytes <= 0)
+  {
+    l2_bytes = DEFAULT_L2_BYTES;
+  }
+
+  long tile = l2_bytes / (3 * sizeof(long));
+  return tile > THRESHOLD ? tile : THRESHOLD;
+}
+
+// Serial merge sort of one tile. source is sorted into result using scratch
+// (of the same size) for the intermediate runs, so a tile never touches
+// memory outside the three buffers and never allocates.
+static void tile_sort( long *result, long *source, long *scratch, long size )
+{
+  if(size <= THRESHOLD)
+  {
+    cilk_quicksort( result, source, size );
+    return;
+  }
+
+  long half = size / 2;
+  tile_sort( scratch, source, result, half );
+  tile_sort( scratch + half, source + half, result + half, size - half );
+  s_merge( result, scratch, half, scratch + half, size - half );
+}
+
+// Serial merge for the final pass: output bypasses the cache through
+// non-temporal stores while both inputs are prefetched ahead of use
+static void s_merge_nt( long *result, long *array_b, long b_size, long *array_c, long c_size )
+{
+  while( b_size > 0 && c_size > 0 )
+  {
+    __builtin_prefetch( array_b + PREFETCH_DISTANCE, 0, 0 );
+    __builtin_prefetch( array_c + PREFETCH_DISTANCE, 0, 0 );
+    if(*array_b <= *array_c)
+    {
+      STREAM_STORE( result, *array_b ); result++; array_b++; b_size--;
+    }
+    else
+    {
+      STREAM_STORE( result, *array_c ); result++; array_c++; c_size--;
+    }
+  }
+
+  while( b_size > 0 )
+  {
+    STREAM_STORE( result, *array_b ); result++; array_b++; b_size--;
+  }
+
+  while( c_size > 0 )
+  {
+    STREAM_STORE( result, *array_c ); result++; array_c++; c_size--;
+  }
+
+  // streaming stores are weakly ordered; make them visible before the
+  // strand that wrote them syncs with its parent
+  STREAM_FENCE();
+}
+
+static void p_merge_nt( long *result, long *array_b, long b_size, long *array_c, long c_size )
+{
+
+  // invert the array that is considered B as B needs to be the larger one
+  if(b_size < c_size)
+  {
+    p_merge_nt( result, array_c, c_size, array_b, b_size );
+  }
+  else if( b_size <= NT_THRESHOLD || c_size == 0 )
+  {
+    s_merge_nt( result, array_b, b_size, array_c, c_size );
+  }
+  else
+  {
+    long mid_index = b_size / 2;
+    long bin_index = binary_search( array_c, c_size, array_b[mid_index] );
+    if(bin_index < 0)
+    {
+      printf("ERROR: Received Invalid Binary Search Result\n");
+      exit(1);
+    }
+
+    result[mid_index + bin_index] = array_b[mid_index];
+
+    cilk_spawn p_merge_nt( result, array_b, mid_index, array_c, bin_index );
+    p_merge_nt( result + mid_index + bin_index + 1, array_b + mid_index + 1, b_size - mid_index - 1, array_c + bin_index, c_size - bin_index);
+    cilk_sync;
+  }
+
+}
+
+// Sorts source into result with scratch (of the same size) holding the runs
+// of each level. Subarrays of at most tile elements are sorted to completion
+// by one strand while they are L2 resident; only then are they merged
+// upwards. The top level merge streams its output past the cache.
+static void tiled_merge_sort( long *result, long *source, long *scratch, long size, long tile, int top )
+{
+  if(size <= tile)
+  {
+    tile_sort( result, source, scratch, size );
+    return;
+  }
+
+  long half = size / 2;
+  cilk_spawn tiled_merge_sort( scratch, source, result, half, tile, 0 );
+  tiled_merge_sort( scratch + half, source + half, result + half, size - half, tile, 0 );
+  cilk_sync;
+
+  if(top)
+  {
+    p_merge_nt( result, scratch, half, scratch + half, size - half );
+  }
+  else
+  {
+    p_merge( result, scratch, half, scratch + half, size - half );
+  }
+}
+
+void cilk_sort_cache_aware_into(long *result, long *source, long size)
+{
+  long *scratch = malloc(sizeof(long) * (size > 0 ? size : 1));
+  if(scratch == 0)
+  {
+    printf("ERROR: Insufficient Memory; size=%ld\n", size);
+    exit(-1);
+  }
+
+  // an in place sort needs the source copied aside first, as the tiles
+  // write their output before their neighbours have been read
+  long *input = source;
+  long *copy = NULL;
+  if(result == source && size > tile_elements())
+  {
+    copy = malloc(sizeof(long) * size);
+    if(copy == 0)
+    {
+      printf("ERROR: Insufficient Memory; size=%ld\n", size);
+      exit(-1);
+    }
+    memcpy( copy, source, sizeof(long) * size );
+    input = copy;
+  }
+
+  long tile = tile_elements();
+  FORK_JOIN_ROOT( tiled_merge_sort( result, input, scratch, size, tile, 1 ) );
+
+  free(copy);
+  free(scratch);
+}
+
+long *cilk_sort_cache_aware(long *array, long size)
+{
+  long *result = malloc(sizeof(long) * (size > 0 ? size : 1));
+  if(result == 0)
+  {
+    printf("Insufficient Memory\n");
+    exit(-1);
+  }
+
+  cilk_sort_cache_aware_into( result, array, size );
+
+  return result;
+}
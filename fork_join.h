@@ -0,0 +1,67 @@
+#ifndef _FORK_JOIN_H_
+#define _FORK_JOIN_H_
+
+// Fork-join primitives used by the cilk engine (the cilk_*.c files). The
+// runtime is selected at build time, see BACKEND in the Makefile:
+//
+//   SORT_BACKEND_CILKPLUS  Cilk Plus / Tapir, -fcilkplus (the default)
+//   SORT_BACKEND_OPENCILK  OpenCilk, -fopencilk
+//   SORT_BACKEND_OPENMP    OpenMP tasks, -fopenmp
+//
+// The engine is written with cilk_spawn and cilk_sync. Under OpenMP a spawn
+// becomes a task and a sync a taskwait; spawned calls must therefore not
+// take local arrays by value, which OpenMP would copy into the task.
+
+#if !defined(SORT_BACKEND_OPENMP) && !defined(SORT_BACKEND_OPENCILK)
+#define SORT_BACKEND_CILKPLUS
+#endif
+
+#if defined(SORT_BACKEND_OPENMP)
+
+#include <omp.h>
+
+#define SORT_BACKEND_NAME "openmp"
+
+#define cilk_spawn _Pragma("omp task")
+#define cilk_sync _Pragma("omp taskwait")
+
+// OpenMP tasks only run in parallel inside a parallel region, so every public
+// entry point of the engine runs its work through FORK_JOIN_ROOT. It opens a
+// region with one task generating thread, unless the caller already is in one.
+#define FORK_JOIN_ROOT(call)       \
+  do                               \
+  {                                \
+    if(omp_in_parallel())          \
+    {                              \
+      call;                        \
+    }                              \
+    else                           \
+    {                              \
+      _Pragma("omp parallel")      \
+      _Pragma("omp single")        \
+      {                            \
+        call;                      \
+      }                            \
+    }                              \
+  } while(0)
+
+#define FORK_JOIN_SHUTDOWN()
+
+#else
+
+#include <cilk/cilk.h>
+
+#define FORK_JOIN_ROOT(call) do { call; } while(0)
+
+#if defined(SORT_BACKEND_OPENCILK)
+#define SORT_BACKEND_NAME "opencilk"
+#define FORK_JOIN_SHUTDOWN()
+#else
+#include <cilk/cilk_api.h>
+#define SORT_BACKEND_NAME "cilkplus"
+#define FORK_JOIN_SHUTDOWN() __cilkrts_end_cilk()
+#endif
+
+#endif
+
+#endif  // _FORK_JOIN_H_
@@ -19,11 +19,20 @@
  * IN THE SOFTWARE.
  **/
 
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <cilk/cilk_api.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "ktiming.h"
+#include "async_sort.h"
+#include "auto_sort.h"
+#include "cilk_sort.h"
+#include "fork_join.h"
+#include "pthread_sort.h"
+#include "stream_sort.h"
+#include "string_sort.h"
 
 #ifndef RAND_MAX
 #define RAND_MAX 32767
@@ -32,6 +41,31 @@
 #define TIMING_COUNT 5
 // #define TIMING_COUNT 1
 
+// Number of bytes read from the input stream at a time and the number of
+// parsed keys handed to the streaming sorter at a time
+#define STREAM_READ_SIZE (1 << 20)
+#define STREAM_BATCH_SIZE 65536
+
+// Cost model read by the auto engine and written by --calibrate; the
+// SORT_MODEL environment variable overrides it for the auto engine
+#define DEFAULT_MODEL_PATH "sort_model.txt"
+
+// Keys of the string engine are formatted as URLs sharing a long common
+// prefix; zero padding makes their byte order match the numeric order
+#define STRING_KEY_FORMAT "http://example.com/item/%019ld"
+#define STRING_KEY_PREFIX_LENGTH 24
+
+// Number of distinct keys of the low cardinality input checked by the cilk
+// engine
+#define FEW_DISTINCT_KEYS 100
+
+// Average number of batches the insert engine splits the array into
+#define INSERT_BATCH_COUNT 64
+
+// Distance between the values of B that the sparse input C of the setops
+// engine holds
+#define SPARSE_STRIDE 1024
+
 static unsigned long rand_nxt = 0;
 
 static inline unsigned long my_rand(void)
@@ -101,9 +135,39 @@ check_result(long *res, unsigned long size, long start, char *name)
     fprintf(stdout, "%s sorting successful.\n", name);
 }
 
-/* forward declaration */
-long *cilk_sort(long *array, unsigned long size);
-long *pthread_sort(long *array, unsigned long size, int thread_count);
+/* Fills arr with start + i % distinct in scrambled order, an input with few
+ * distinct keys that sends cilk_sort down its counting path */
+static void fill_few_distinct(long *arr, unsigned long size, long start, long distinct)
+{
+  for (unsigned long i = 0; i < size; ++i)
+  {
+    arr[i] = start + (long)(i % distinct);
+  }
+  scramble_array(arr, size);
+}
+
+/* Checks a sort of fill_few_distinct's output: key start + v appears
+ * size / distinct times, once more for v < size % distinct */
+static void
+check_few_distinct(long *res, unsigned long size, long start, long distinct, char *name)
+{
+  printf("Now check result with %ld distinct keys ... \n", distinct);
+  int success = 1;
+  unsigned long i = 0;
+  for (long v = 0; v < distinct; v++)
+  {
+    unsigned long run = size / distinct + ((unsigned long)v < size % distinct);
+    for (unsigned long j = 0; j < run; j++, i++)
+    {
+      if (res[i] != start + v)
+        success = 0;
+    }
+  }
+  if (!success)
+    fprintf(stdout, "%s sorting FAILURE!\n", name);
+  else
+    fprintf(stdout, "%s sorting successful.\n", name);
+}
 
 void call_cilk_sort(long *array, unsigned long size, long start, int check)
 {
@@ -132,6 +196,54 @@ void call_cilk_sort(long *array, unsigned long size, long start, int check)
   }
 
   print_runtime(elapsed_time, TIMING_COUNT);
+
+  if (check)
+  {
+    /* few distinct keys take the low cardinality (counting) path */
+    long *few = malloc((size + 1) * sizeof(long));
+    if (few == NULL)
+    {
+      printf("ERROR: Insufficient Memory; size=%ld\n", size);
+      exit(-1);
+    }
+    fill_few_distinct(few, size, start, FEW_DISTINCT_KEYS);
+    cilk_res = cilk_sort(few, size);
+    check_few_distinct(cilk_res, size, start, FEW_DISTINCT_KEYS, "cilk_sort");
+    if (few != cilk_res)
+    {
+      free(cilk_res);
+    }
+    free(few);
+  }
+}
+
+void call_cache_aware_sort(long *array, unsigned long size, long start, int check)
+{
+  clockmark_t begin, end;
+  uint64_t elapsed_time[TIMING_COUNT];
+  long *cilk_res = NULL;
+
+  for (int i = 0; i < TIMING_COUNT; i++)
+  {
+    /* calling the cache-aware variant of the cilk sort */
+    begin = ktiming_getmark();
+    cilk_res = cilk_sort_cache_aware(array, size);
+    end = ktiming_getmark();
+    elapsed_time[i] = ktiming_diff_usec(&begin, &end);
+
+    if (check && i == 0)
+    {
+      check_result(cilk_res, size, start, "cilk_sort_cache_aware");
+    }
+    // free the array if not the same
+    if (array != cilk_res)
+    {
+      free(cilk_res);
+    }
+    scramble_array(array, size);
+  }
+
+  print_runtime(elapsed_time, TIMING_COUNT);
 }
 
 void call_pthread_sort(long *array, unsigned long size, long start, int check, int thread_count)
@@ -163,6 +275,714 @@ void call_pthread_sort(long *array, unsigned long size, long start, int check, i
   print_runtime(elapsed_time, TIMING_COUNT);
 }
 
+void call_auto_sort(long *array, unsigned long size, long start, int check)
+{
+  clockmark_t begin, end;
+  uint64_t elapsed_time[TIMING_COUNT];
+  long *auto_res = NULL;
+  CostModel_t model;
+  SortPlan_t plan;
+
+  // a calibrated model (see --calibrate) takes precedence over the defaults
+  const char *model_path = getenv("SORT_MODEL") ? getenv("SORT_MODEL") : DEFAULT_MODEL_PATH;
+  auto_sort_default_model(&model);
+  if (auto_sort_load_model(&model, model_path))
+  {
+    fprintf(stdout, "Cost model: %s\n", model_path);
+  }
+  else
+  {
+    fprintf(stdout, "Cost model: built-in defaults\n");
+  }
+
+  for (int i = 0; i < TIMING_COUNT; i++)
+  {
+    /* calling the sort whose engine is picked by the cost model */
+    begin = ktiming_getmark();
+    auto_res = auto_sort(&model, array, size, &plan);
+    end = ktiming_getmark();
+    elapsed_time[i] = ktiming_diff_usec(&begin, &end);
+
+    if (check && i == 0)
+    {
+      check_result(auto_res, size, start, "auto_sort");
+      fprintf(stdout, "Plan: engine %s, %d threads, cut-off %ld, sortedness %.2f, ~%ld distinct, predicted %.6f s\n",
+              sort_engine_name(plan.engine), plan.thread_count, plan.threshold,
+              plan.sortedness, plan.distinct, plan.predicted);
+    }
+    // free the array if not the same
+    if (array != auto_res)
+    {
+      free(auto_res);
+    }
+    scramble_array(array, size);
+  }
+
+  print_runtime(elapsed_time, TIMING_COUNT);
+}
+
+void call_string_sort(long *array, unsigned long size, long start, int check)
+{
+  clockmark_t begin, end;
+  uint64_t elapsed_time[TIMING_COUNT];
+  long length = snprintf(NULL, 0, STRING_KEY_FORMAT, 0L);
+  char *arena = malloc(size * (length + 1));
+  StringRef_t *refs = malloc(size * sizeof(StringRef_t));
+  if (arena == NULL || refs == NULL)
+  {
+    printf("ERROR: Insufficient Memory; size=%ld\n", size);
+    exit(-1);
+  }
+
+  for (int i = 0; i < TIMING_COUNT; i++)
+  {
+    for (unsigned long j = 0; j < size; j++)
+    {
+      sprintf(arena + j * length, STRING_KEY_FORMAT, array[j]);
+      refs[j].offset = j * length;
+      refs[j].length = length;
+    }
+
+    /* calling the string sort; only the references move */
+    begin = ktiming_getmark();
+    cilk_string_sort(arena, refs, size);
+    end = ktiming_getmark();
+    elapsed_time[i] = ktiming_diff_usec(&begin, &end);
+
+    if (check && i == 0)
+    {
+      long *keys = malloc(size * sizeof(long));
+      if (keys == NULL)
+      {
+        printf("ERROR: Insufficient Memory; size=%ld\n", size);
+        exit(-1);
+      }
+      for (unsigned long j = 0; j < size; j++)
+      {
+        keys[j] = strtol(arena + refs[j].offset + STRING_KEY_PREFIX_LENGTH, NULL, 10);
+      }
+      check_result(keys, size, start, "cilk_string_sort");
+      free(keys);
+    }
+    scramble_array(array, size);
+  }
+
+  free(refs);
+  free(arena);
+  print_runtime(elapsed_time, TIMING_COUNT);
+}
+
+/* Serial two-pointer version of the set operations for checking: op 0 is
+ * the union, 1 the intersection and 2 the difference B minus C */
+static long reference_set_operation(int op, long *result, long *b, long b_size, long *c, long c_size)
+{
+  long i = 0, j = 0, count = 0;
+
+  while (i < b_size || j < c_size)
+  {
+    if (j == c_size || (i < b_size && b[i] < c[j]))
+    {
+      if (op != 1)
+        result[count++] = b[i];
+      i++;
+    }
+    else if (i == b_size || c[j] < b[i])
+    {
+      if (op == 0)
+        result[count++] = c[j];
+      j++;
+    }
+    else
+    {
+      if (op != 2)
+        result[count++] = b[i];
+      i++;
+      j++;
+    }
+  }
+
+  return count;
+}
+
+static void check_set_operations(long *b, long b_size, long *c, long c_size, const char *inputs)
+{
+  static const char *names[3] = {"cilk_set_union", "cilk_set_intersection", "cilk_set_difference"};
+  long *result = malloc((b_size + c_size + 1) * sizeof(long));
+  long *expected = malloc((b_size + c_size + 1) * sizeof(long));
+  if (result == NULL || expected == NULL)
+  {
+    printf("ERROR: Insufficient Memory; size=%ld\n", b_size + c_size);
+    exit(-1);
+  }
+
+  printf("Now check set operations on %s inputs ... \n", inputs);
+  long matches = 0;
+  for (int op = 0; op < 3; op++)
+  {
+    long count = op == 0 ? cilk_set_union(result, b, b_size, c, c_size)
+               : op == 1 ? cilk_set_intersection(result, b, b_size, c, c_size)
+                         : cilk_set_difference(result, b, b_size, c, c_size);
+    long expected_count = reference_set_operation(op, expected, b, b_size, c, c_size);
+    int success = count == expected_count &&
+                  memcmp(result, expected, count * sizeof(long)) == 0;
+    if (op == 1)
+      matches = expected_count;
+    fprintf(stdout, "%s %s.\n", names[op], success ? "successful" : "FAILURE!");
+  }
+
+  /* inputs hold distinct values, so the join pairs up the intersection */
+  long *b_index, *c_index;
+  long pairs = cilk_merge_join(b, b_size, c, c_size, &b_index, &c_index);
+  int success = pairs == matches;
+  for (long k = 0; success && k < pairs; k++)
+  {
+    if (b[b_index[k]] != c[c_index[k]] || (k > 0 && b_index[k] <= b_index[k - 1]))
+      success = 0;
+  }
+  fprintf(stdout, "cilk_merge_join %s.\n", success ? "successful" : "FAILURE!");
+
+  free(b_index);
+  free(c_index);
+  free(result);
+  free(expected);
+}
+
+/* Checks the set operations on inputs that are hard to cut evenly (C wholly
+ * after B, C a sparse subset of B, C overlapping half of B) and times the
+ * union of the disjoint pair */
+void call_set_operations(long *array, unsigned long size, long start, int check)
+{
+  clockmark_t begin, end;
+  uint64_t elapsed_time[TIMING_COUNT];
+  long *b = malloc(size * sizeof(long));
+  long *c = malloc(size * sizeof(long));
+  long *result = malloc(2 * size * sizeof(long));
+  if (b == NULL || c == NULL || result == NULL)
+  {
+    printf("ERROR: Insufficient Memory; size=%ld\n", size);
+    exit(-1);
+  }
+
+  cilk_sort_into(b, array, size);
+
+  if (check)
+  {
+    for (unsigned long i = 0; i < size; i++)
+      c[i] = start + size + i;
+    check_set_operations(b, size, c, size, "disjoint");
+
+    long sparse_size = (size + SPARSE_STRIDE - 1) / SPARSE_STRIDE;
+    for (long i = 0; i < sparse_size; i++)
+      c[i] = start + i * SPARSE_STRIDE;
+    check_set_operations(b, size, c, sparse_size, "sparse");
+    check_set_operations(c, sparse_size, b, size, "sparse and dense");
+
+    for (unsigned long i = 0; i < size; i++)
+      c[i] = start + size / 2 + i;
+    check_set_operations(b, size, c, size, "overlapping");
+  }
+
+  for (unsigned long i = 0; i < size; i++)
+    c[i] = start + size + i;
+  for (int i = 0; i < TIMING_COUNT; i++)
+  {
+    /* the disjoint union is the worst case for cutting by one input only */
+    begin = ktiming_getmark();
+    cilk_set_union(result, b, size, c, size);
+    end = ktiming_getmark();
+    elapsed_time[i] = ktiming_diff_usec(&begin, &end);
+  }
+
+  free(b);
+  free(c);
+  free(result);
+  print_runtime(elapsed_time, TIMING_COUNT);
+}
+
+/* Prints whether a check named name passed, in the style of check_result */
+static void report_check(int success, const char *name)
+{
+  fprintf(stdout, "%s %s.\n", name, success ? "successful" : "FAILURE!");
+}
+
+/* Checks the selection operators against the sorted order of the permuted
+ * array, whose element of rank r is start + r, and times cilk_nth_element */
+void call_selection(long *array, unsigned long size, long start, int check)
+{
+  clockmark_t begin, end;
+  uint64_t elapsed_time[TIMING_COUNT];
+  long k = size / 3;
+  long *work = malloc((size + 1) * sizeof(long));
+  if (work == NULL)
+  {
+    printf("ERROR: Insufficient Memory; size=%ld\n", size);
+    exit(-1);
+  }
+
+  if (check && size > 0)
+  {
+    printf("Now check selection ... \n");
+
+    memcpy(work, array, size * sizeof(long));
+    cilk_nth_element(work, size, k);
+    int success = work[k] == start + k;
+    for (unsigned long i = 0; i < size; i++)
+    {
+      if ((long)i < k ? work[i] > work[k] : work[i] < work[k])
+        success = 0;
+    }
+    report_check(success, "cilk_nth_element");
+
+    memcpy(work, array, size * sizeof(long));
+    cilk_partial_sort(work, size, k);
+    success = 1;
+    for (unsigned long i = 0; i < size; i++)
+    {
+      if ((long)i < k ? work[i] != start + (long)i : work[i] < start + k)
+        success = 0;
+    }
+    report_check(success, "cilk_partial_sort");
+
+    long *top = cilk_top_k(array, size, k);
+    success = 1;
+    for (long i = 0; i < k; i++)
+    {
+      if (top[i] != start + i)
+        success = 0;
+    }
+    free(top);
+    report_check(success, "cilk_top_k");
+
+    long ranks[5] = {(long)size - 1, 0, (long)size / 2, k, (long)size / 4};
+    long values[5];
+    memcpy(work, array, size * sizeof(long));
+    cilk_select_ranks(work, size, ranks, 5, values);
+    success = 1;
+    for (int i = 0; i < 5; i++)
+    {
+      if (values[i] != start + ranks[i])
+        success = 0;
+    }
+    report_check(success, "cilk_select_ranks");
+
+    double percents[5] = {50.0, 0.0, 99.9, 25.0, 100.0};
+    memcpy(work, array, size * sizeof(long));
+    cilk_percentiles(work, size, percents, 5, values);
+    success = 1;
+    for (int i = 0; i < 5; i++)
+    {
+      if (values[i] != start + (long)(percents[i] / 100.0 * (size - 1)))
+        success = 0;
+    }
+    report_check(success, "cilk_percentiles");
+  }
+
+  for (int i = 0; i < TIMING_COUNT; i++)
+  {
+    memcpy(work, array, size * sizeof(long));
+
+    /* calling the parallel selection of the element of rank k */
+    begin = ktiming_getmark();
+    if (size > 0)
+      cilk_nth_element(work, size, k);
+    end = ktiming_getmark();
+    elapsed_time[i] = ktiming_diff_usec(&begin, &end);
+  }
+
+  free(work);
+  print_runtime(elapsed_time, TIMING_COUNT);
+}
+
+/* Builds the sorted array by inserting the permuted array in randomly sized
+ * batches, the way cilk_sorted_insert absorbs keys as they arrive */
+void call_sorted_insert(long *array, unsigned long size, long start, int check)
+{
+  clockmark_t begin, end;
+  uint64_t elapsed_time[TIMING_COUNT];
+  SortedArray_t sorted;
+  unsigned long mean_batch = size / INSERT_BATCH_COUNT + 1;
+
+  for (int i = 0; i < TIMING_COUNT; i++)
+  {
+    cilk_sorted_init(&sorted);
+
+    /* calling the batch insertion; batches hold 1 to 2 * mean_batch keys */
+    begin = ktiming_getmark();
+    unsigned long inserted = 0;
+    while (inserted < size)
+    {
+      unsigned long batch = 1 + my_rand() % (2 * mean_batch);
+      if (batch > size - inserted)
+        batch = size - inserted;
+      if (!cilk_sorted_insert(&sorted, array + inserted, batch))
+      {
+        printf("ERROR: Insufficient Memory; size=%ld\n", size);
+        exit(-1);
+      }
+      inserted += batch;
+    }
+    end = ktiming_getmark();
+    elapsed_time[i] = ktiming_diff_usec(&begin, &end);
+
+    if (check && i == 0)
+    {
+      if (sorted.size != (long)size)
+        fprintf(stdout, "cilk_sorted_insert sorting FAILURE! (%ld keys instead of %ld)\n", sorted.size, size);
+      else
+        check_result(sorted.data, size, start, "cilk_sorted_insert");
+    }
+    cilk_sorted_free(&sorted);
+    scramble_array(array, size);
+  }
+
+  print_runtime(elapsed_time, TIMING_COUNT);
+}
+
+/* Number of completion callbacks per final state, bumped from the workers */
+static long async_callbacks[3];
+
+static void count_async_callback(SortJob_t *job, SortJobState_t state, void *user_data)
+{
+  __sync_fetch_and_add(&async_callbacks[state], 1);
+}
+
+/* Submits a sort into a separate output, an in place sort, an empty sort and
+ * a sort that is cancelled at once to one pool, checks their final states,
+ * eventfd, callbacks and output, then times submit/wait round trips */
+void call_async_sort(long *array, unsigned long size, long start, int check, int thread_count)
+{
+  clockmark_t begin, end;
+  uint64_t elapsed_time[TIMING_COUNT];
+  SortPool_t *pool = sort_pool_create(thread_count > 0 ? thread_count : 1);
+  long *result = malloc((size + 1) * sizeof(long));
+  long *in_place = malloc((size + 1) * sizeof(long));
+  long *cancelled = malloc((size + 1) * sizeof(long));
+  if (pool == NULL || result == NULL || in_place == NULL || cancelled == NULL)
+  {
+    printf("ERROR: Insufficient Memory; size=%ld\n", size);
+    exit(-1);
+  }
+
+  if (check)
+  {
+    memcpy(in_place, array, size * sizeof(long));
+    memcpy(cancelled, array, size * sizeof(long));
+    memset(async_callbacks, 0, sizeof(async_callbacks));
+
+    SortJob_t *jobs[4];
+    jobs[0] = sort_submit(pool, result, array, size, count_async_callback, NULL);
+    jobs[1] = sort_submit(pool, in_place, in_place, size, count_async_callback, NULL);
+    jobs[2] = sort_submit(pool, NULL, NULL, 0, count_async_callback, NULL);
+    jobs[3] = sort_submit(pool, cancelled, cancelled, size, count_async_callback, NULL);
+    sort_cancel(jobs[3]);
+
+    /* the eventfd of a job becomes readable once sort_poll reports it done */
+    printf("Now check async jobs ... \n");
+    struct pollfd watch = {sort_job_eventfd(jobs[0]), POLLIN, 0};
+    int success = watch.fd >= 0 && poll(&watch, 1, -1) == 1 &&
+                  sort_poll(jobs[0]) == SORT_JOB_DONE;
+    report_check(success, "sort_job_eventfd");
+
+    SortJobState_t states[4];
+    for (int j = 0; j < 4; j++)
+      states[j] = sort_wait(jobs[j]);
+    report_check(states[0] == SORT_JOB_DONE && states[1] == SORT_JOB_DONE && states[2] == SORT_JOB_DONE,
+                 "sort_wait");
+
+    /* the cancelled job may have finished before the request reached it */
+    report_check(states[3] == SORT_JOB_CANCELLED || states[3] == SORT_JOB_DONE, "sort_cancel");
+    if (states[3] == SORT_JOB_DONE)
+      check_result(cancelled, size, start, "sort_submit (cancelled too late)");
+
+    /* callbacks run after sort_wait returns, so give them time to land */
+    for (int tries = 0; tries < 1000 && async_callbacks[SORT_JOB_DONE] + async_callbacks[SORT_JOB_CANCELLED] < 4; tries++)
+      usleep(1000);
+    report_check(async_callbacks[SORT_JOB_DONE] == 3 + (states[3] == SORT_JOB_DONE) &&
+                 async_callbacks[SORT_JOB_CANCELLED] == (states[3] == SORT_JOB_CANCELLED),
+                 "sort callbacks");
+
+    check_result(result, size, start, "sort_submit");
+    check_result(in_place, size, start, "sort_submit (in place)");
+
+    for (int j = 0; j < 4; j++)
+      sort_job_release(jobs[j]);
+  }
+
+  for (int i = 0; i < TIMING_COUNT; i++)
+  {
+    /* calling the asynchronous sort and waiting for it */
+    begin = ktiming_getmark();
+    SortJob_t *job = sort_submit(pool, result, array, size, NULL, NULL);
+    sort_wait(job);
+    end = ktiming_getmark();
+    elapsed_time[i] = ktiming_diff_usec(&begin, &end);
+
+    sort_job_release(job);
+    scramble_array(array, size);
+  }
+
+  sort_pool_destroy(pool);
+  free(result);
+  free(in_place);
+  free(cancelled);
+  print_runtime(elapsed_time, TIMING_COUNT);
+}
+
+typedef struct
+{
+  long key;
+  long value;
+} Pair_t;
+
+static int compare_pairs(const void *a, const void *b)
+{
+  long x = ((const Pair_t *)a)->key, y = ((const Pair_t *)b)->key;
+  return (x > y) - (x < y);
+}
+
+/* Checks cilk_sort_unique, cilk_sort_count and cilk_sort_group_by on
+ * source against a serial qsort of the pairs followed by a pass over the
+ * runs of equal keys */
+static void check_aggregates(long *source, unsigned long size, const char *inputs)
+{
+  static const char *names[3] = {"cilk_sort_group_by sum", "cilk_sort_group_by min", "cilk_sort_group_by max"};
+  long *values = malloc((size + 1) * sizeof(long));
+  long *keys = malloc((size + 1) * sizeof(long));
+  long *result = malloc((size + 1) * sizeof(long));
+  long *expected = malloc(5 * (size + 1) * sizeof(long));
+  Pair_t *pairs = malloc((size + 1) * sizeof(Pair_t));
+  if (values == NULL || keys == NULL || result == NULL || expected == NULL || pairs == NULL)
+  {
+    printf("ERROR: Insufficient Memory; size=%ld\n", size);
+    exit(-1);
+  }
+
+  printf("Now check aggregates on %s keys ... \n", inputs);
+
+  /* expected holds the distinct keys, then their counts, sums, minima and
+   * maxima */
+  long *expected_counts = expected + size + 1;
+  long *expected_values = expected + 2 * (size + 1);
+  my_srand(2);
+  for (unsigned long i = 0; i < size; i++)
+  {
+    values[i] = (long)(my_rand() % 2001) - 1000;
+    pairs[i].key = source[i];
+    pairs[i].value = values[i];
+  }
+  qsort(pairs, size, sizeof(Pair_t), compare_pairs);
+
+  long *sums = expected_values, *mins = sums + size + 1, *maxs = mins + size + 1;
+  long distinct = 0;
+  for (unsigned long i = 0; i < size; i++)
+  {
+    long value = pairs[i].value;
+    if (i == 0 || pairs[i].key != pairs[i - 1].key)
+    {
+      expected[distinct] = pairs[i].key;
+      expected_counts[distinct] = 0;
+      sums[distinct] = 0;
+      mins[distinct] = maxs[distinct] = value;
+      distinct++;
+    }
+    expected_counts[distinct - 1]++;
+    sums[distinct - 1] += value;
+    if (value < mins[distinct - 1])
+      mins[distinct - 1] = value;
+    if (value > maxs[distinct - 1])
+      maxs[distinct - 1] = value;
+  }
+
+  long count = cilk_sort_unique(keys, source, size);
+  report_check(count == distinct && memcmp(keys, expected, count * sizeof(long)) == 0,
+               "cilk_sort_unique");
+
+  count = cilk_sort_count(keys, result, source, size);
+  report_check(count == distinct && memcmp(keys, expected, count * sizeof(long)) == 0 &&
+                   memcmp(result, expected_counts, count * sizeof(long)) == 0,
+               "cilk_sort_count");
+
+  Aggregate_t ops[3] = {AGGREGATE_SUM, AGGREGATE_MIN, AGGREGATE_MAX};
+  for (int op = 0; op < 3; op++)
+  {
+    count = cilk_sort_group_by(keys, result, source, values, size, ops[op]);
+    report_check(count == distinct && memcmp(keys, expected, count * sizeof(long)) == 0 &&
+                     memcmp(result, expected_values + op * (size + 1), count * sizeof(long)) == 0,
+                 names[op]);
+  }
+
+  free(values);
+  free(keys);
+  free(result);
+  free(expected);
+  free(pairs);
+}
+
+/* Checks the aggregate operators on the permuted array, on few distinct
+ * keys and on skewed keys (three in four equal to start, so runs of the hot
+ * key span many pieces of the final merge), and times cilk_sort_count */
+void call_aggregates(long *array, unsigned long size, long start, int check)
+{
+  clockmark_t begin, end;
+  uint64_t elapsed_time[TIMING_COUNT];
+  long *keys = malloc((size + 1) * sizeof(long));
+  long *counts = malloc((size + 1) * sizeof(long));
+  if (keys == NULL || counts == NULL)
+  {
+    printf("ERROR: Insufficient Memory; size=%ld\n", size);
+    exit(-1);
+  }
+
+  if (check)
+  {
+    check_aggregates(array, size, "distinct");
+
+    long *skewed = malloc((size + 1) * sizeof(long));
+    if (skewed == NULL)
+    {
+      printf("ERROR: Insufficient Memory; size=%ld\n", size);
+      exit(-1);
+    }
+    fill_few_distinct(skewed, size, start, FEW_DISTINCT_KEYS);
+    check_aggregates(skewed, size, "few distinct");
+
+    for (unsigned long i = 0; i < size; i++)
+      skewed[i] = i % 4 == 0 ? start + i : start;
+    scramble_array(skewed, size);
+    check_aggregates(skewed, size, "skewed");
+    free(skewed);
+  }
+
+  for (int i = 0; i < TIMING_COUNT; i++)
+  {
+    begin = ktiming_getmark();
+    cilk_sort_count(keys, counts, array, size);
+    end = ktiming_getmark();
+    elapsed_time[i] = ktiming_diff_usec(&begin, &end);
+  }
+
+  free(keys);
+  free(counts);
+  print_runtime(elapsed_time, TIMING_COUNT);
+}
+
+/* Parses whitespace separated decimal keys from input and pushes them into
+ * stream as they arrive; returns the number of keys read */
+static long read_stream(FILE *input, StreamSorter_t *stream)
+{
+  char *buffer = malloc(STREAM_READ_SIZE);
+  long *batch = malloc(sizeof(long) * STREAM_BATCH_SIZE);
+  long batch_fill = 0;
+  long total = 0;
+  long value = 0;
+  int negative = 0;
+  int in_number = 0;
+  size_t bytes;
+
+  if (buffer == NULL || batch == NULL)
+  {
+    fprintf(stderr, "Insufficient Memory\n");
+    exit(-1);
+  }
+
+  /* a key may straddle two reads, so the parser state persists across them */
+  while ((bytes = fread(buffer, 1, STREAM_READ_SIZE, input)) > 0)
+  {
+    for (size_t i = 0; i < bytes; i++)
+    {
+      char c = buffer[i];
+      if (c >= '0' && c <= '9')
+      {
+        value = value * 10 + (c - '0');
+        in_number = 1;
+      }
+      else if (c == '-' && !in_number)
+      {
+        negative = 1;
+      }
+      else if (in_number)
+      {
+        batch[batch_fill++] = negative ? -value : value;
+        value = 0;
+        negative = 0;
+        in_number = 0;
+        if (batch_fill == STREAM_BATCH_SIZE)
+        {
+          stream_sort_push(stream, batch, batch_fill);
+          total += batch_fill;
+          batch_fill = 0;
+        }
+      }
+      else
+      {
+        negative = 0;
+      }
+    }
+  }
+
+  if (in_number)
+  {
+    batch[batch_fill++] = negative ? -value : value;
+  }
+  stream_sort_push(stream, batch, batch_fill);
+  total += batch_fill;
+
+  free(batch);
+  free(buffer);
+  return total;
+}
+
+/* Sorts the keys of path (stdin when NULL) while they are still arriving.
+ * The sorted keys go to stdout and the timings to stderr. */
+void call_stream_sort(int thread_count, const char *path)
+{
+  clockmark_t begin, ingested, end;
+  FILE *input = stdin;
+  long size = 0;
+
+  if (path != NULL && (input = fopen(path, "r")) == NULL)
+  {
+    perror(path);
+    exit(-1);
+  }
+
+  StreamSorter_t *stream = stream_sort_create(thread_count, 0);
+  if (stream == NULL)
+  {
+    exit(-1);
+  }
+
+  begin = ktiming_getmark();
+  long count = read_stream(input, stream);
+  ingested = ktiming_getmark();
+  long *result = stream_sort_finish(stream, &size);
+  end = ktiming_getmark();
+
+  int success = (result != NULL && size == count);
+  for (long i = 1; success && i < size; i++)
+  {
+    if (result[i - 1] > result[i])
+      success = 0;
+  }
+  fprintf(stderr, "stream_sort %s.\n", success ? "sorting successful" : "sorting FAILURE!");
+  fprintf(stderr, "Keys: %ld\n", count);
+  fprintf(stderr, "Ingest time: %4lf s\n", ktiming_diff_sec(&begin, &ingested));
+  fprintf(stderr, "Final merge time: %4lf s\n", ktiming_diff_sec(&ingested, &end));
+  fprintf(stderr, "Total time: %4lf s\n", ktiming_diff_sec(&begin, &end));
+
+  for (long i = 0; i < size; i++)
+  {
+    fprintf(stdout, "%ld\n", result[i]);
+  }
+
+  free(result);
+  stream_sort_destroy(stream);
+  if (input != stdin)
+  {
+    fclose(input);
+  }
+}
+
 int main(int argc, char **argv)
 {
 
@@ -170,17 +990,42 @@ int main(int argc, char **argv)
   int check = 1;
   unsigned long size = 10000000;
   int thread_count = 1;
+  const char *engine = "all";
   long *array;
 
+  if (argc >= 3 && strcmp(argv[1], "--stream") == 0)
+  {
+    call_stream_sort(atol(argv[2]), argc > 3 ? argv[3] : NULL);
+    return 0;
+  }
+
+  if (argc >= 2 && strcmp(argv[1], "--calibrate") == 0)
+  {
+    CostModel_t model;
+    const char *model_path = argc > 2 ? argv[2] : DEFAULT_MODEL_PATH;
+    fprintf(stdout, "Fork-join backend: %s\n", SORT_BACKEND_NAME);
+    int saved = auto_sort_calibrate(&model, model_path);
+    if (saved)
+    {
+      fprintf(stdout, "Cost model written to %s\n", model_path);
+    }
+    FORK_JOIN_SHUTDOWN();
+    return saved ? 0 : 1;
+  }
+
   if (argc < 3)
   {
     if (argc == 1 && argv[0][0] != '\0')
     {
-      fprintf(stderr, "Usage: %s <n> <n>\n", argv[0]);
+      fprintf(stderr, "Usage: %s <n> <n> [all|cilk|cache|pthread|auto|string|setops|select|insert|async|aggregate]\n", argv[0]);
+      fprintf(stderr, "       %s --stream <n> [file]\n", argv[0]);
+      fprintf(stderr, "       %s --calibrate [model file]\n", argv[0]);
     }
     else
     {
-      fprintf(stderr, "Usage: ./sort <n> <n>\n");
+      fprintf(stderr, "Usage: ./sort <n> <n> [all|cilk|cache|pthread|auto|string|setops|select|insert|async|aggregate]\n");
+      fprintf(stderr, "       ./sort --stream <n> [file]\n");
+      fprintf(stderr, "       ./sort --calibrate [model file]\n");
     }
     exit(0);
   }
@@ -190,15 +1035,60 @@ int main(int argc, char **argv)
   // number of threads
   thread_count = atol(argv[2]);
 
+  // engine(s) to run; "all" runs cilk_sort and pthread_sort
+  if (argc > 3)
+  {
+    engine = argv[3];
+  }
+
   long start = my_rand();
 
+  fprintf(stdout, "Fork-join backend: %s\n", SORT_BACKEND_NAME);
   fprintf(stdout, "Creating a randomly permuted array of size %ld.\n", size);
   array = (long *)malloc(size * sizeof(long));
   fill_array(array, size, start);
 
-  call_cilk_sort(array, size, start, check);
-  __cilkrts_end_cilk();
-  call_pthread_sort(array, size, start, check, thread_count);
+  if (strcmp(engine, "all") == 0 || strcmp(engine, "cilk") == 0)
+  {
+    call_cilk_sort(array, size, start, check);
+  }
+  if (strcmp(engine, "cache") == 0)
+  {
+    call_cache_aware_sort(array, size, start, check);
+  }
+  if (strcmp(engine, "auto") == 0)
+  {
+    call_auto_sort(array, size, start, check);
+  }
+  if (strcmp(engine, "string") == 0)
+  {
+    call_string_sort(array, size, start, check);
+  }
+  if (strcmp(engine, "setops") == 0)
+  {
+    call_set_operations(array, size, start, check);
+  }
+  if (strcmp(engine, "select") == 0)
+  {
+    call_selection(array, size, start, check);
+  }
+  if (strcmp(engine, "insert") == 0)
+  {
+    call_sorted_insert(array, size, start, check);
+  }
+  if (strcmp(engine, "async") == 0)
+  {
+    call_async_sort(array, size, start, check, thread_count);
+  }
+  if (strcmp(engine, "aggregate") == 0)
+  {
+    call_aggregates(array, size, start, check);
+  }
+  FORK_JOIN_SHUTDOWN();
+  if (strcmp(engine, "all") == 0 || strcmp(engine, "pthread") == 0)
+  {
+    call_pthread_sort(array, size, start, check, thread_count);
+  }
 
   free(array);
 
@@ -0,0 +1,364 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#define read_cycles() __rdtsc()
+#else
+#define HAVE_TSC 0
+#define read_cycles() 0
+#endif
+
+#include "ktiming.h"
+#include "cilk_sort.h"
+#include "fork_join.h"
+#include "pthread_sort.h"
+
+// Array sizes swept by the benchmark, from L1 resident (8KB) to DRAM
+// resident (32MB)
+#define MIN_SIZE (1L << 10)
+#define MAX_SIZE (1L << 22)
+
+// Each (kernel, distribution, size) point is timed this many times, scaled
+// so that every point processes roughly WORK_PER_POINT elements
+#define MIN_SAMPLES 5
+#define MAX_SAMPLES 200
+#define WORK_PER_POINT (1L << 23)
+
+// Number of lookups per sample of the binary search kernels
+#define QUERY_COUNT 4096
+
+// Subarray size handed to the leaf sorts; MergeSort reaches its leaves in
+// blocks of at most THRESHOLD elements
+#ifndef THRESHOLD
+#define THRESHOLD 512
+#endif
+
+// Number of distinct keys of the few-unique distribution
+#define FEW_UNIQUE_KEYS 16
+
+typedef enum
+{
+  DIST_RANDOM,
+  DIST_SORTED,
+  DIST_REVERSED,
+  DIST_FEW_UNIQUE,
+  DIST_COUNT
+} Distribution_t;
+
+static const char *distribution_names[DIST_COUNT] =
+{
+  "random", "sorted", "reversed", "few-unique"
+};
+
+// Buffers of one benchmark point. input holds the keys in distribution
+// order; sorted_b and sorted_c are its two halves, each sorted, as a merge
+// would receive them; sorted is the whole input sorted.
+typedef struct
+{
+  long size;
+  long *input;
+  long *sorted;
+  long *sorted_b;
+  long *sorted_c;
+  long *work;
+  long *output;
+} Bench_t;
+
+// A kernel under test. prepare (may be NULL) restores the state that run
+// consumes and is not timed; run returns the number of elements processed.
+typedef struct
+{
+  const char *name;
+  void (*prepare)( Bench_t *bench );
+  long (*run)( Bench_t *bench );
+} Kernel_t;
+
+// Keeps the results of the search kernels alive
+static volatile long sink;
+
+///////////////////////////////////////////////////////////////////////////////
+//                                  Kernels                                  //
+///////////////////////////////////////////////////////////////////////////////
+
+static long run_binary_search( Bench_t *bench )
+{
+  long total = 0;
+  long i;
+  for( i = 0; i < QUERY_COUNT; i++ )
+  {
+    total += binary_search( bench->sorted, bench->size, bench->input[i % bench->size] );
+  }
+  sink = total;
+  return QUERY_COUNT;
+}
+
+static long run_pthread_binary_search( Bench_t *bench )
+{
+  long total = 0;
+  long i;
+  for( i = 0; i < QUERY_COUNT; i++ )
+  {
+    total += pthread_binary_search( bench->sorted, bench->size, bench->input[i % bench->size] );
+  }
+  sink = total;
+  return QUERY_COUNT;
+}
+
+static long run_s_merge( Bench_t *bench )
+{
+  long half = bench->size / 2;
+  s_merge( bench->output, bench->sorted_b, half, bench->sorted_c, bench->size - half );
+  return bench->size;
+}
+
+static long run_pthread_s_merge( Bench_t *bench )
+{
+  long half = bench->size / 2;
+  pthread_s_merge( bench->output, bench->sorted_b, half, bench->sorted_c, bench->size - half );
+  return bench->size;
+}
+
+static long run_p_merge( Bench_t *bench )
+{
+  long half = bench->size / 2;
+  cilk_merge( bench->output, bench->sorted_b, half, bench->sorted_c, bench->size - half );
+  return bench->size;
+}
+
+static void prepare_partition( Bench_t *bench )
+{
+  memcpy( bench->work, bench->input, sizeof(long) * bench->size );
+}
+
+static long run_cilk_partition( Bench_t *bench )
+{
+  sink = cilk_partition( bench->work, 0, bench->size - 1 );
+  return bench->size;
+}
+
+static long run_leaf_quicksort( Bench_t *bench )
+{
+  long i;
+  for( i = 0; i < bench->size; i += THRESHOLD )
+  {
+    long length = bench->size - i < THRESHOLD ? bench->size - i : THRESHOLD;
+    cilk_quicksort( bench->output + i, bench->input + i, length );
+  }
+  return bench->size;
+}
+
+static long run_pthread_leaf_quicksort( Bench_t *bench )
+{
+  long i;
+  for( i = 0; i < bench->size; i += THRESHOLD )
+  {
+    long length = bench->size - i < THRESHOLD ? bench->size - i : THRESHOLD;
+    pthread_quicksort( bench->output + i, bench->input + i, length );
+  }
+  return bench->size;
+}
+
+static const Kernel_t kernels[] =
+{
+  { "binary_search",         NULL,              run_binary_search },
+  { "pthread_binary_search", NULL,              run_pthread_binary_search },
+  { "s_merge",               NULL,              run_s_merge },
+  { "pthread_s_merge",       NULL,              run_pthread_s_merge },
+  { "p_merge",               NULL,              run_p_merge },
+  { "cilk_partition",        prepare_partition, run_cilk_partition },
+  { "leaf_quicksort",        NULL,              run_leaf_quicksort },
+  { "pthread_leaf_quicksort", NULL,             run_pthread_leaf_quicksort },
+};
+
+#define KERNEL_COUNT ((int)(sizeof(kernels) / sizeof(kernels[0])))
+
+///////////////////////////////////////////////////////////////////////////////
+//                                  Driver                                   //
+///////////////////////////////////////////////////////////////////////////////
+
+static void fill_input( long *array, long size, Distribution_t distribution )
+{
+  unsigned long rand_nxt = 1;
+  long i;
+
+  for( i = 0; i < size; i++ )
+  {
+    rand_nxt = rand_nxt * 1103515245 + 12345;
+    switch(distribution)
+    {
+    case DIST_SORTED:
+      array[i] = i;
+      break;
+    case DIST_REVERSED:
+      array[i] = size - i;
+      break;
+    case DIST_FEW_UNIQUE:
+      array[i] = (long)((rand_nxt >> 16) % FEW_UNIQUE_KEYS);
+      break;
+    case DIST_RANDOM:
+    default:
+      array[i] = (long)(rand_nxt >> 1);
+      break;
+    }
+  }
+}
+
+static void setup_bench( Bench_t *bench, long size, Distribution_t distribution )
+{
+  long half = size / 2;
+
+  bench->size = size;
+  fill_input( bench->input, size, distribution );
+
+  memcpy( bench->sorted_b, bench->input, sizeof(long) * half );
+  memcpy( bench->sorted_c, bench->input + half, sizeof(long) * (size - half) );
+  cilk_sort_into( bench->sorted_b, bench->sorted_b, half );
+  cilk_sort_into( bench->sorted_c, bench->sorted_c, size - half );
+  cilk_sort_into( bench->sorted, bench->input, size );
+}
+
+static void bench_point( const Kernel_t *kernel, Bench_t *bench, const char *distribution )
+{
+  long samples = WORK_PER_POINT / bench->size;
+  if(samples < MIN_SAMPLES)
+  {
+    samples = MIN_SAMPLES;
+  }
+  if(samples > MAX_SAMPLES)
+  {
+    samples = MAX_SAMPLES;
+  }
+
+  double sum = 0.0, sum_squares = 0.0, best = 0.0;
+  double cycle_sum = 0.0, cycle_best = 0.0;
+  long s;
+
+  // one untimed pass to fault in the buffers and warm the caches
+  if(kernel->prepare)
+  {
+    kernel->prepare( bench );
+  }
+  kernel->run( bench );
+
+  for( s = 0; s < samples; s++ )
+  {
+    if(kernel->prepare)
+    {
+      kernel->prepare( bench );
+    }
+
+    clockmark_t begin = ktiming_getmark();
+    unsigned long long cycles_begin = read_cycles();
+    long elements = kernel->run( bench );
+    unsigned long long cycles_end = read_cycles();
+    clockmark_t end = ktiming_getmark();
+
+    double ns = (double)(end - begin) / elements;
+    double cycles = (double)(cycles_end - cycles_begin) / elements;
+
+    sum += ns;
+    sum_squares += ns * ns;
+    cycle_sum += cycles;
+    if(s == 0 || ns < best)
+    {
+      best = ns;
+    }
+    if(s == 0 || cycles < cycle_best)
+    {
+      cycle_best = cycles;
+    }
+  }
+
+  double mean = sum / samples;
+  double variance = sum_squares / samples - mean * mean;
+  double stddev = variance > 0.0 ? sqrt(variance) : 0.0;
+
+  printf("%-22s %-10s %9ld %6ld %9.3f %8.3f %9.3f", kernel->name, distribution, bench->size, samples, mean, stddev, best);
+  if(HAVE_TSC)
+  {
+    printf(" %9.2f %9.2f\n", cycle_sum / samples, cycle_best);
+  }
+  else
+  {
+    printf(" %9s %9s\n", "-", "-");
+  }
+}
+
+int main(int argc, char **argv)
+{
+  const char *only = argc > 1 ? argv[1] : "all";
+  long max_size = argc > 2 ? atol(argv[2]) : MAX_SIZE;
+  if(max_size < MIN_SIZE)
+  {
+    max_size = MIN_SIZE;
+  }
+
+  int k;
+  int found = strcmp(only, "all") == 0;
+  for( k = 0; k < KERNEL_COUNT; k++ )
+  {
+    found |= strcmp(only, kernels[k].name) == 0;
+  }
+  if(!found)
+  {
+    fprintf(stderr, "Usage: %s [all|<kernel>] [max size]\n", argv[0]);
+    fprintf(stderr, "Kernels:");
+    for( k = 0; k < KERNEL_COUNT; k++ )
+    {
+      fprintf(stderr, " %s", kernels[k].name);
+    }
+    fprintf(stderr, "\n");
+    exit(1);
+  }
+
+  Bench_t bench;
+  bench.input    = malloc(sizeof(long) * max_size);
+  bench.sorted   = malloc(sizeof(long) * max_size);
+  bench.sorted_b = malloc(sizeof(long) * max_size);
+  bench.sorted_c = malloc(sizeof(long) * max_size);
+  bench.work     = malloc(sizeof(long) * max_size);
+  bench.output   = malloc(sizeof(long) * max_size);
+  if(!bench.input || !bench.sorted || !bench.sorted_b || !bench.sorted_c || !bench.work || !bench.output)
+  {
+    printf("ERROR: Insufficient Memory; size=%ld\n", max_size);
+    exit(-1);
+  }
+
+  printf("Fork-join backend: %s\n", SORT_BACKEND_NAME);
+  printf("Times per element (per lookup for the searches); cycles are TSC ticks\n");
+  printf("%-22s %-10s %9s %6s %9s %8s %9s %9s %9s\n",
+         "kernel", "input", "size", "reps", "ns/elem", "stddev", "min", "cyc/elem", "min");
+
+  long size;
+  int d;
+  for( d = 0; d < DIST_COUNT; d++ )
+  {
+    for( size = MIN_SIZE; size <= max_size; size *= 4 )
+    {
+      // the inputs are shared by every kernel of the point
+      setup_bench( &bench, size, (Distribution_t)d );
+      for( k = 0; k < KERNEL_COUNT; k++ )
+      {
+        if(strcmp(only, "all") == 0 || strcmp(only, kernels[k].name) == 0)
+        {
+          bench_point( &kernels[k], &bench, distribution_names[d] );
+        }
+      }
+    }
+  }
+
+  free(bench.input);
+  free(bench.sorted);
+  free(bench.sorted_b);
+  free(bench.sorted_c);
+  free(bench.work);
+  free(bench.output);
+
+  FORK_JOIN_SHUTDOWN();
+
+  return 0;
+}
@@ -0,0 +1,28 @@
+#!/bin/sh
+
+# Strong and weak scaling series for mpi_sort on one host. Usage:
+#   ./mpi_scaling.sh [n] [max ranks]
+# Strong scaling sorts n keys in total, weak scaling n keys per rank.
+
+N=${1:-10000000}
+MAX_RANKS=${2:-8}
+
+for MODE in strong weak
+do
+  echo "$MODE scaling, n = $N"
+  echo "ranks time speedup efficiency"
+  BASE=""
+  RANKS=1
+  while [ $RANKS -le $MAX_RANKS ]
+  do
+    ARGS="$N"
+    if [ $MODE = weak ]; then ARGS="$N weak"; fi
+    TIME=`mpirun --oversubscribe -np $RANKS ./mpi_sort $ARGS | grep 'Total time' | awk '{print $3}'`
+    if [ -z "$BASE" ]; then BASE=$TIME; fi
+    echo "$RANKS $TIME $BASE $MODE" | awk '{
+      speedup = ($4 == "weak") ? $3 / $2 * $1 : $3 / $2;
+      printf "%d %s %.2f %.2f\n", $1, $2, speedup, speedup / $1 }'
+    RANKS=`expr $RANKS \* 2`
+  done
+  echo
+done
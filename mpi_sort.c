@@ -0,0 +1,336 @@
+/**
+ * Distributed samplesort. Every rank sorts its share of the keys with the
+ * cilk engine, the ranks agree on p - 1 global splitters drawn from regular
+ * samples of the sorted shares, exchange keys with one all-to-all so rank r
+ * receives every key between splitters r - 1 and r, and finish with a local
+ * merge of the p runs received. Run with e.g.
+ *
+ *   mpirun -np 4 ./mpi_sort 10000000          (strong scaling: n keys total)
+ *   mpirun -np 4 ./mpi_sort 10000000 weak     (weak scaling: n keys per rank)
+ *
+ * mpi_scaling.sh runs both series over a range of rank counts.
+ **/
+
+#include <mpi.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cilk_sort.h"
+#include "ktiming.h"
+
+// Number of regular samples each rank contributes per rank in the job. More
+// samples give splitters that balance the received key counts more closely.
+#define OVERSAMPLING 32
+
+#define TRUE 1
+#define FALSE 0
+
+///////////////////////////////////////////////////////////////////////////////
+//                          Function Implementation                          //
+///////////////////////////////////////////////////////////////////////////////
+
+static void fill_local_array( long *array, long size, int rank )
+{
+  unsigned long rand_nxt = 1 + rank;
+  long i;
+
+  for( i = 0; i < size; ++i )
+  {
+    rand_nxt = rand_nxt * 1103515245 + 12345;
+    array[i] = (long)(rand_nxt >> 1);
+  }
+}
+
+// Number of elements of the sorted array that are <= value
+static long upper_bound( long *array, long size, long value )
+{
+  long lo = 0;
+  long hi = size;
+
+  while(lo < hi)
+  {
+    long mid = lo + (hi - lo) / 2;
+    if(array[mid] <= value)
+    {
+      lo = mid + 1;
+    }
+    else
+    {
+      hi = mid;
+    }
+  }
+
+  return lo;
+}
+
+// Merges the run_count sorted runs laid out back to back in buffer (run i
+// starts at offsets[i], offsets[run_count] is the total) by merging
+// neighbouring pairs with the parallel merge until one run is left. Returns
+// whichever of buffer and scratch holds the result.
+static long *merge_runs( long *buffer, long *scratch, int *offsets, int run_count )
+{
+  int *bounds = malloc(sizeof(int) * (run_count + 1));
+  if(bounds == 0)
+  {
+    printf("Insufficient Memory\n");
+    exit(-1);
+  }
+  memcpy( bounds, offsets, sizeof(int) * (run_count + 1) );
+
+  while(run_count > 1)
+  {
+    int merged_count = 0;
+    int i;
+
+    for( i = 0; i < run_count; i += 2 )
+    {
+      long start = bounds[i];
+      if(i + 1 < run_count)
+      {
+        long middle = bounds[i + 1];
+        long end = bounds[i + 2];
+        cilk_merge( scratch + start, buffer + start, middle - start, buffer + middle, end - middle );
+      }
+      else
+      {
+        memcpy( scratch + start, buffer + start, sizeof(long) * (bounds[i + 1] - start) );
+      }
+      bounds[merged_count++] = start;
+    }
+    bounds[merged_count] = bounds[run_count];
+    run_count = merged_count;
+
+    long *swap_buffer = buffer;
+    buffer  = scratch;
+    scratch = swap_buffer;
+  }
+
+  free(bounds);
+  return buffer;
+}
+
+// Checks that every rank holds sorted keys, that the ranks are ordered
+// among themselves and that no key was lost
+static int check_result( long *array, long size, long total, int rank, int rank_count )
+{
+  int success = TRUE;
+  long i;
+
+  for( i = 1; i < size; i++ )
+  {
+    if(array[i - 1] > array[i])
+    {
+      success = FALSE;
+    }
+  }
+
+  // each rank passes its largest key to the next non-empty rank's check by
+  // forwarding the running maximum
+  long previous_max = 0;
+  int has_previous = FALSE;
+  if(rank > 0)
+  {
+    long message[2];
+    MPI_Recv( message, 2, MPI_LONG, rank - 1, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE );
+    has_previous = (int)message[0];
+    previous_max = message[1];
+  }
+  if(has_previous && size > 0 && previous_max > array[0])
+  {
+    success = FALSE;
+  }
+  if(rank + 1 < rank_count)
+  {
+    long message[2];
+    message[0] = has_previous || size > 0;
+    message[1] = size > 0 ? array[size - 1] : previous_max;
+    MPI_Send( message, 2, MPI_LONG, rank + 1, 0, MPI_COMM_WORLD );
+  }
+
+  long received = 0;
+  MPI_Allreduce( &size, &received, 1, MPI_LONG, MPI_SUM, MPI_COMM_WORLD );
+  if(received != total)
+  {
+    success = FALSE;
+  }
+
+  int all_success = FALSE;
+  MPI_Allreduce( &success, &all_success, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD );
+  return all_success;
+}
+
+static double phase_seconds( clockmark_t *begin, clockmark_t *end )
+{
+  double local = ktiming_diff_sec( begin, end );
+  double slowest = 0.0;
+
+  // a phase lasts as long as its slowest rank
+  MPI_Reduce( &local, &slowest, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD );
+  return slowest;
+}
+
+int main(int argc, char **argv)
+{
+  int rank, rank_count;
+  int weak = FALSE;
+
+  MPI_Init( &argc, &argv );
+  MPI_Comm_rank( MPI_COMM_WORLD, &rank );
+  MPI_Comm_size( MPI_COMM_WORLD, &rank_count );
+
+  if(argc < 2)
+  {
+    if(rank == 0)
+    {
+      fprintf(stderr, "Usage: mpirun -np <p> %s <n> [weak]\n", argv[0]);
+    }
+    MPI_Finalize();
+    return 0;
+  }
+
+  long n = atol(argv[1]);
+  if(argc > 2 && strcmp(argv[2], "weak") == 0)
+  {
+    weak = TRUE;
+  }
+
+  // strong scaling splits n keys over the ranks; weak scaling gives every
+  // rank n keys
+  long total = weak ? n * rank_count : n;
+  long local_size = total / rank_count + (rank < total % rank_count ? 1 : 0);
+
+  long *local = malloc(sizeof(long) * (local_size > 0 ? local_size : 1));
+  if(local == 0)
+  {
+    printf("Insufficient Memory\n");
+    MPI_Abort( MPI_COMM_WORLD, -1 );
+  }
+  fill_local_array( local, local_size, rank );
+
+  if(rank == 0)
+  {
+    fprintf(stdout, "Sorting %ld keys on %d ranks (%s scaling).\n", total, rank_count, weak ? "weak" : "strong");
+  }
+
+  clockmark_t t_begin, t_sorted, t_splitters, t_exchanged, t_merged;
+  MPI_Barrier( MPI_COMM_WORLD );
+  t_begin = ktiming_getmark();
+
+  // Step 1. Sort the local share
+  long *sorted = cilk_sort( local, local_size );
+  free(local);
+  t_sorted = ktiming_getmark();
+
+  // Step 2. Pick global splitters from regular samples of every share
+  int sample_count = OVERSAMPLING * rank_count;
+  long *samples = malloc(sizeof(long) * sample_count);
+  long *all_samples = malloc(sizeof(long) * sample_count * rank_count);
+  long *splitters = malloc(sizeof(long) * rank_count);
+  if(samples == 0 || all_samples == 0 || splitters == 0)
+  {
+    printf("Insufficient Memory\n");
+    MPI_Abort( MPI_COMM_WORLD, -1 );
+  }
+
+  int i;
+  for( i = 0; i < sample_count; i++ )
+  {
+    // an empty share contributes samples that sort to the top
+    samples[i] = local_size > 0 ? sorted[(local_size * (long)i) / sample_count] : __LONG_MAX__;
+  }
+  MPI_Allgather( samples, sample_count, MPI_LONG, all_samples, sample_count, MPI_LONG, MPI_COMM_WORLD );
+
+  long *sorted_samples = cilk_sort( all_samples, (long)sample_count * rank_count );
+  for( i = 1; i < rank_count; i++ )
+  {
+    splitters[i - 1] = sorted_samples[(long)i * sample_count];
+  }
+  free(sorted_samples);
+  free(all_samples);
+  free(samples);
+  t_splitters = ktiming_getmark();
+
+  // Step 3. Route every key to the rank owning its splitter interval
+  int *send_counts = malloc(sizeof(int) * rank_count);
+  int *send_displs = malloc(sizeof(int) * (rank_count + 1));
+  int *recv_counts = malloc(sizeof(int) * rank_count);
+  int *recv_displs = malloc(sizeof(int) * (rank_count + 1));
+  if(send_counts == 0 || send_displs == 0 || recv_counts == 0 || recv_displs == 0)
+  {
+    printf("Insufficient Memory\n");
+    MPI_Abort( MPI_COMM_WORLD, -1 );
+  }
+
+  send_displs[0] = 0;
+  for( i = 0; i < rank_count; i++ )
+  {
+    long end = (i + 1 < rank_count) ? upper_bound( sorted, local_size, splitters[i] ) : local_size;
+    if(end < send_displs[i])
+    {
+      end = send_displs[i];
+    }
+    send_counts[i] = (int)(end - send_displs[i]);
+    send_displs[i + 1] = (int)end;
+  }
+
+  MPI_Alltoall( send_counts, 1, MPI_INT, recv_counts, 1, MPI_INT, MPI_COMM_WORLD );
+
+  recv_displs[0] = 0;
+  for( i = 0; i < rank_count; i++ )
+  {
+    recv_displs[i + 1] = recv_displs[i] + recv_counts[i];
+  }
+  long received = recv_displs[rank_count];
+
+  long *buffer = malloc(sizeof(long) * (received > 0 ? received : 1));
+  long *scratch = malloc(sizeof(long) * (received > 0 ? received : 1));
+  if(buffer == 0 || scratch == 0)
+  {
+    printf("Insufficient Memory\n");
+    MPI_Abort( MPI_COMM_WORLD, -1 );
+  }
+
+  MPI_Alltoallv( sorted, send_counts, send_displs, MPI_LONG,
+                 buffer, recv_counts, recv_displs, MPI_LONG, MPI_COMM_WORLD );
+  free(sorted);
+  t_exchanged = ktiming_getmark();
+
+  // Step 4. Merge the sorted runs received from every rank
+  long *result = merge_runs( buffer, scratch, recv_displs, rank_count );
+  t_merged = ktiming_getmark();
+
+  double local_sort_time = phase_seconds( &t_begin, &t_sorted );
+  double splitter_time   = phase_seconds( &t_sorted, &t_splitters );
+  double exchange_time   = phase_seconds( &t_splitters, &t_exchanged );
+  double merge_time      = phase_seconds( &t_exchanged, &t_merged );
+  double total_time      = phase_seconds( &t_begin, &t_merged );
+
+  long largest = 0;
+  MPI_Reduce( &received, &largest, 1, MPI_LONG, MPI_MAX, 0, MPI_COMM_WORLD );
+
+  int success = check_result( result, received, total, rank, rank_count );
+
+  if(rank == 0)
+  {
+    fprintf(stdout, "mpi_sort sorting %s\n", success ? "successful." : "FAILURE!");
+    fprintf(stdout, "Local sort time: %4lf s\n", local_sort_time);
+    fprintf(stdout, "Splitter time: %4lf s\n", splitter_time);
+    fprintf(stdout, "Exchange time: %4lf s\n", exchange_time);
+    fprintf(stdout, "Merge time: %4lf s\n", merge_time);
+    fprintf(stdout, "Total time: %4lf s\n", total_time);
+    fprintf(stdout, "Load imbalance: %.3f\n", total > 0 ? (double)largest * rank_count / total : 1.0);
+  }
+
+  free(buffer);
+  free(scratch);
+  free(splitters);
+  free(send_counts);
+  free(send_displs);
+  free(recv_counts);
+  free(recv_displs);
+
+  MPI_Finalize();
+  return 0;
+}
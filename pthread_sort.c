@@ -5,9 +5,12 @@
 #include <stdlib.h>
 #include <string.h>
 
-// Specifies the cut-off size of the array before it switches from
-// parallel merges/sorts to a serial implementation
-#define THRESHOLD 512
+#include "pthread_sort.h"
+
+// Default cut-off size of the array before a context switches from
+// parallel merges/sorts to a serial implementation; named apart from the
+// cilk engine's THRESHOLD, which make GRAIN=n overrides
+#define DEFAULT_THRESHOLD 512
 
 #define TRUE 1
 #define FALSE 0
@@ -16,9 +19,30 @@
 //                             Type Declarations                             //
 ///////////////////////////////////////////////////////////////////////////////
 
+// Owns the thread budget and tuning of one sorter. Every sort that is handed
+// the same context draws its helper threads from the same budget, so
+// concurrent callers share the cores instead of each assuming they own them.
+struct SortContext
+{
+  // manage access to the active thread_count
+  pthread_mutex_t mutex;
+
+  // Running count of the helper threads currently running on behalf of this context
+  long thread_count;
+
+  // Maximum number of helper threads this context may have running at once
+  long thread_max;
+
+  // cut-off size below which sorts/merges are performed serially; read
+  // under mutex once per call and carried in the call's arguments
+  long threshold;
+};
+
 // Contains the arguments that get passed to the pthread_sort functions
 typedef struct
 {
+  SortContext_t *ctx;
+  long threshold;
   long *result;
   long *source;
   long size;
@@ -27,6 +51,8 @@ typedef struct
 // Represents the arguments passed as part of the merge process
 typedef struct
 {
+  SortContext_t *ctx;
+  long threshold;
   long *result;
   long *array_b;
   long *array_c;
@@ -34,19 +60,6 @@ typedef struct
   long c_size;
 } MergeArg_t;
 
-///////////////////////////////////////////////////////////////////////////////
-//                             Global Variables                              //
-///////////////////////////////////////////////////////////////////////////////
-
-// manage access to the active thread_count
-pthread_mutex_t mutex_;
-
-// Running count of the number of threads within the threads array that are currently running
-long thread_count_ = 0;
-
-// Stores the size of the thread pool that is specified from command line
-long THREAD_MAX_NUM = 0;
-
 ///////////////////////////////////////////////////////////////////////////////
 //                             Function Prototypes                           //
 ///////////////////////////////////////////////////////////////////////////////
@@ -54,13 +67,10 @@ long pthread_binary_search( long *search_array, long array_size, long value );
 void pthread_s_merge( long *result, long *array_b, long b_size, long *array_c, long c_size );
 void* pthread_p_merge( void* args );
 void* pthread_merge_sort( void *args );
-void internal_pthread_join( long thread_index );
-void internal_pthread_create(void *(*start_routine) (void *), void* args, long *p_thread_index);
-int initialize_threads( int num_of_threads );
-int cleanup_threads();
-long *pthread_sort(long *array, long size, int num_of_threads);
-int increment_thread_count();
-void decrement_thread_count();
+int initialize_threads( SortContext_t *ctx, int num_of_threads );
+int cleanup_threads( SortContext_t *ctx );
+int increment_thread_count( SortContext_t *ctx );
+void decrement_thread_count( SortContext_t *ctx );
 
 ///////////////////////////////////////////////////////////////////////////////
 //                          Function Implementation                          //
@@ -147,18 +157,25 @@ void* pthread_p_merge( void* args )
   if(pMergeArgs->b_size < pMergeArgs->c_size)
   {
     MergeArg_t merge_args;
-    merge_args.result  = pMergeArgs->result;
-    merge_args.array_b = pMergeArgs->array_c;
-    merge_args.b_size  = pMergeArgs->c_size;
-    merge_args.array_c = pMergeArgs->array_b;;
-    merge_args.c_size  = pMergeArgs->b_size;
+    merge_args.ctx       = pMergeArgs->ctx;
+    merge_args.threshold = pMergeArgs->threshold;
+    merge_args.result    = pMergeArgs->result;
+    merge_args.array_b   = pMergeArgs->array_c;
+    merge_args.b_size    = pMergeArgs->c_size;
+    merge_args.array_c   = pMergeArgs->array_b;;
+    merge_args.c_size    = pMergeArgs->b_size;
     pthread_p_merge( (void*)&merge_args );
   }
-  else if( pMergeArgs->b_size <= THRESHOLD )
+  else if( pMergeArgs->b_size <= pMergeArgs->threshold )
   {
     // perform sequential merge rather than parallel
     pthread_s_merge( pMergeArgs->result, pMergeArgs->array_b, pMergeArgs->b_size, pMergeArgs->array_c, pMergeArgs->c_size );
   }
+  else if( pMergeArgs->c_size == 0 )
+  {
+    // nothing to interleave; the binary search below needs a non-empty C
+    memcpy( pMergeArgs->result, pMergeArgs->array_b, sizeof(long) * pMergeArgs->b_size );
+  }
   else
   {
     long mid_index = pMergeArgs->b_size / 2;
@@ -172,12 +189,14 @@ void* pthread_p_merge( void* args )
 
     // handle values less than the mid_index value within B
     MergeArg_t left_args;
-    left_args.result  = pMergeArgs->result;
-    left_args.array_b = pMergeArgs->array_b;
-    left_args.b_size  = mid_index;
-    left_args.array_c = pMergeArgs->array_c;
-    left_args.c_size  = bin_index;
-    if(increment_thread_count() == TRUE)
+    left_args.ctx       = pMergeArgs->ctx;
+    left_args.threshold = pMergeArgs->threshold;
+    left_args.result    = pMergeArgs->result;
+    left_args.array_b   = pMergeArgs->array_b;
+    left_args.b_size    = mid_index;
+    left_args.array_c   = pMergeArgs->array_c;
+    left_args.c_size    = bin_index;
+    if(increment_thread_count(pMergeArgs->ctx) == TRUE)
     {
       pthread_create( &thread_ctx, NULL, &pthread_p_merge, &left_args );
       needs_cleanup = TRUE;
@@ -193,18 +212,20 @@ void* pthread_p_merge( void* args )
 
     // handle values larger than the mid_index value within B
     MergeArg_t right_args;
-    right_args.result  = pMergeArgs->result + mid_index + bin_index + 1;
-    right_args.array_b = pMergeArgs->array_b + mid_index + 1;
-    right_args.b_size  = pMergeArgs->b_size - mid_index - 1;
-    right_args.array_c = pMergeArgs->array_c + bin_index;
-    right_args.c_size  = pMergeArgs->c_size - bin_index;
+    right_args.ctx       = pMergeArgs->ctx;
+    right_args.threshold = pMergeArgs->threshold;
+    right_args.result    = pMergeArgs->result + mid_index + bin_index + 1;
+    right_args.array_b   = pMergeArgs->array_b + mid_index + 1;
+    right_args.b_size    = pMergeArgs->b_size - mid_index - 1;
+    right_args.array_c   = pMergeArgs->array_c + bin_index;
+    right_args.c_size    = pMergeArgs->c_size - bin_index;
     pthread_p_merge( (void*)&right_args );
 
     // Need to wait for the thread created to handle the left half of problem
     if(needs_cleanup == TRUE)
     {
       pthread_join( thread_ctx, NULL );
-      decrement_thread_count();
+      decrement_thread_count(pMergeArgs->ctx);
     }
   }
 
@@ -253,7 +274,10 @@ void pthread_quicksort( long *result, long *source, long size )
   // the following sort algorithm will perform an in place
   // sorting of the data so it needs to be copied to the
   // destination buffer so that they sorting can be performed
-  memcpy( result, source, sizeof(long) * size);
+  if(result != source)
+  {
+    memcpy( result, source, sizeof(long) * size);
+  }
   pthread_recursive_quicksort( result, 0, size - 1 );
 }
 
@@ -264,7 +288,7 @@ void* pthread_merge_sort( void *args )
   pthread_t thread_ctx;
   int needs_cleanup = FALSE;
 
-  if(pSortArgs->size <= THRESHOLD)
+  if(pSortArgs->size <= pSortArgs->threshold)
   {
     pthread_quicksort( pSortArgs->result, pSortArgs->source, pSortArgs->size );
   }
@@ -283,10 +307,12 @@ void* pthread_merge_sort( void *args )
     }
 
     SortArg_t left_args;
-    left_args.result = C;
-    left_args.source = pSortArgs->source;
-    left_args.size   = pSortArgs->size / 2;
-    if(increment_thread_count() == TRUE)
+    left_args.ctx       = pSortArgs->ctx;
+    left_args.threshold = pSortArgs->threshold;
+    left_args.result    = C;
+    left_args.source    = pSortArgs->source;
+    left_args.size      = pSortArgs->size / 2;
+    if(increment_thread_count(pSortArgs->ctx) == TRUE)
     {
       pthread_create( &thread_ctx, NULL, &pthread_merge_sort, &left_args );
       needs_cleanup = TRUE;
@@ -301,24 +327,28 @@ void* pthread_merge_sort( void *args )
     }
 
     SortArg_t right_args;
-    right_args.result = C + (pSortArgs->size / 2);
-    right_args.source = pSortArgs->source + (pSortArgs->size / 2);
-    right_args.size   = pSortArgs->size - (pSortArgs->size / 2);
+    right_args.ctx       = pSortArgs->ctx;
+    right_args.threshold = pSortArgs->threshold;
+    right_args.result    = C + (pSortArgs->size / 2);
+    right_args.source    = pSortArgs->source + (pSortArgs->size / 2);
+    right_args.size      = pSortArgs->size - (pSortArgs->size / 2);
     pthread_merge_sort((void*)&right_args);
 
     // Need to wait for the thread created to handle the left half of problem
     if(needs_cleanup == TRUE)
     {
       pthread_join( thread_ctx, NULL );
-      decrement_thread_count();
+      decrement_thread_count(pSortArgs->ctx);
     }
 
     MergeArg_t merge_args;
-    merge_args.result  = pSortArgs->result;
-    merge_args.array_b = C;
-    merge_args.b_size  = (pSortArgs->size / 2);
-    merge_args.array_c = C + (pSortArgs->size / 2);
-    merge_args.c_size  = pSortArgs->size - (pSortArgs->size / 2);
+    merge_args.ctx       = pSortArgs->ctx;
+    merge_args.threshold = pSortArgs->threshold;
+    merge_args.result    = pSortArgs->result;
+    merge_args.array_b   = C;
+    merge_args.b_size    = (pSortArgs->size / 2);
+    merge_args.array_c   = C + (pSortArgs->size / 2);
+    merge_args.c_size    = pSortArgs->size - (pSortArgs->size / 2);
     pthread_p_merge( (void*)&merge_args );
 
     free(C);
@@ -327,102 +357,180 @@ void* pthread_merge_sort( void *args )
   return NULL;
 }
 
-int increment_thread_count()
+int increment_thread_count( SortContext_t *ctx )
 {
   int ret_val = TRUE;
-  pthread_mutex_lock( &mutex_ );
-  if(thread_count_ >= THREAD_MAX_NUM)
+  pthread_mutex_lock( &ctx->mutex );
+  if(ctx->thread_count >= ctx->thread_max)
   {
     ret_val = FALSE;
   }
   else
   {
-    thread_count_ += 1;
+    ctx->thread_count += 1;
     ret_val = TRUE;
   }
-  pthread_mutex_unlock( &mutex_ );
+  pthread_mutex_unlock( &ctx->mutex );
   return ret_val;
 }
 
-void decrement_thread_count()
+void decrement_thread_count( SortContext_t *ctx )
 {
-  pthread_mutex_lock(&mutex_);
-  thread_count_ -= 1;
-  pthread_mutex_unlock(&mutex_);
+  pthread_mutex_lock(&ctx->mutex);
+  ctx->thread_count -= 1;
+  pthread_mutex_unlock(&ctx->mutex);
 }
 
-int initialize_threads( int num_of_threads )
+int initialize_threads( SortContext_t *ctx, int num_of_threads )
 {
 
-  // Step 1. Need to initialize the mutex for protecting access to thread_count and
-  //         thread pool
-  if(pthread_mutex_init(&mutex_, NULL) != 0)
+  // Step 1. Need to initialize the mutex for protecting access to thread_count
+  if(pthread_mutex_init(&ctx->mutex, NULL) != 0)
   {
     printf("ERROR: Failed to initialize mutex\n");
     return FALSE;
   }
 
   // Step 2. Reset active thread count
-  thread_count_ = 0;
+  ctx->thread_count = 0;
 
-  // Step 3. Configure the thread pool size global
-  THREAD_MAX_NUM = num_of_threads;
+  // Step 3. Configure the thread pool size and the default cut-off
+  ctx->thread_max = num_of_threads;
+  ctx->threshold  = DEFAULT_THRESHOLD;
 
   return TRUE;
 }
 
-int cleanup_threads()
+int cleanup_threads( SortContext_t *ctx )
 {
 
   // Step 1. Destroy the mutex
-  if(pthread_mutex_destroy(&mutex_) != 0)
+  if(pthread_mutex_destroy(&ctx->mutex) != 0)
   {
     printf("ERROR: Failed to destroy the mutex properly\n");
     return FALSE;
   }
 
   // Step 2. Reset the thread pool size and active counts
-  thread_count_  = 0;
-  THREAD_MAX_NUM = 0;
+  ctx->thread_count = 0;
+  ctx->thread_max   = 0;
 
   return TRUE;
 }
 
-long *pthread_sort(long *array, long size, int num_of_threads) 
+SortContext_t *pthread_sort_context_create( int num_of_threads )
 {
-  int error = FALSE;
+  SortContext_t *ctx = malloc(sizeof(SortContext_t));
+  if(ctx == 0)
+  {
+    printf("Insufficient Memory\n");
+    return NULL;
+  }
 
-  // attempt to initialize all the resources necessary to manage
-  // the specified thread pool size
-  if(!initialize_threads(num_of_threads))
+  if(!initialize_threads(ctx, num_of_threads))
   {
-    printf("ERROR: Failed to inialize memory system\n");
-    return array;
+    free(ctx);
+    return NULL;
+  }
+
+  return ctx;
+}
+
+void pthread_sort_context_destroy( SortContext_t *ctx )
+{
+  if(ctx == NULL)
+  {
+    return;
+  }
+
+  if(!cleanup_threads(ctx))
+  {
+    printf("ERROR: Failed to release resources from thread pool\n");
   }
+  free(ctx);
+}
+
+void pthread_sort_context_set_threshold( SortContext_t *ctx, long threshold )
+{
+  // a cut-off of zero would recurse forever on single element arrays
+  if(threshold < 1)
+  {
+    threshold = 1;
+  }
+
+  pthread_mutex_lock(&ctx->mutex);
+  ctx->threshold = threshold;
+  pthread_mutex_unlock(&ctx->mutex);
+}
+
+// Cut-off of ctx as of now; a call reads it once so that a concurrent
+// pthread_sort_context_set_threshold never races with the recursion
+static long read_threshold( SortContext_t *ctx )
+{
+  pthread_mutex_lock(&ctx->mutex);
+  long threshold = ctx->threshold;
+  pthread_mutex_unlock(&ctx->mutex);
+  return threshold;
+}
+
+void pthread_sort_into_ctx(SortContext_t *ctx, long *result, long *source, long size)
+{
+  SortArg_t args;
+  args.ctx       = ctx;
+  args.threshold = read_threshold( ctx );
+  args.result    = result;
+  args.source    = source;
+  args.size      = size;
+  pthread_merge_sort( (void*)&args );
+}
+
+void pthread_merge_ctx(SortContext_t *ctx, long *result, long *array_b, long b_size, long *array_c, long c_size)
+{
+  MergeArg_t args;
+  args.ctx       = ctx;
+  args.threshold = read_threshold( ctx );
+  args.result    = result;
+  args.array_b   = array_b;
+  args.b_size    = b_size;
+  args.array_c   = array_c;
+  args.c_size    = c_size;
+  pthread_p_merge( (void*)&args );
+}
 
+long *pthread_sort_ctx(SortContext_t *ctx, long *array, long size)
+{
   long *result = malloc(sizeof(long) * size);
   if(result == 0)
   {
     printf("Insufficient Memory\n");
-    error = TRUE;
+    return array;
   }
 
-  if(error == FALSE)
+  pthread_sort_into_ctx( ctx, result, array, size );
+
+  return result;
+}
+
+long *pthread_sort(long *array, long size, int num_of_threads) 
+{
+  // each call gets a private context so that independent callers never
+  // share (and corrupt) each other's thread budget
+  SortContext_t ctx;
+
+  // attempt to initialize all the resources necessary to manage
+  // the specified thread pool size
+  if(!initialize_threads(&ctx, num_of_threads))
   {
-    SortArg_t args;
-    args.result = result;
-    args.source = array;
-    args.size   = size;
-    pthread_merge_sort( (void*)&args );
+    printf("ERROR: Failed to inialize memory system\n");
+    return array;
   }
 
-  if(!cleanup_threads())
+  long *result = pthread_sort_ctx(&ctx, array, size);
+
+  if(!cleanup_threads(&ctx))
   {
     printf("ERROR: Failed to release resources from thread pool\n");
   }
 
-  if(error == FALSE)
-    return result;
-  else
-    return array;
+  return result;
 }
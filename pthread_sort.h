@@ -0,0 +1,30 @@
+#ifndef _PTHREAD_SORT_H_
+#define _PTHREAD_SORT_H_
+
+// Opaque sorter context. It owns the helper thread budget and the serial
+// cut-off of the pthread engine and may be shared by concurrent callers;
+// all sorts issued through one context compete for the same budget.
+typedef struct SortContext SortContext_t;
+
+SortContext_t *pthread_sort_context_create( int num_of_threads );
+void pthread_sort_context_destroy( SortContext_t *ctx );
+void pthread_sort_context_set_threshold( SortContext_t *ctx, long threshold );
+
+// Sorts array into a newly allocated buffer using the budget of ctx
+long *pthread_sort_ctx(SortContext_t *ctx, long *array, long size);
+
+// Sorts source into result (which may be source itself) using the budget of ctx
+void pthread_sort_into_ctx(SortContext_t *ctx, long *result, long *source, long size);
+
+// Merges the sorted arrays B and C into result using the budget of ctx
+void pthread_merge_ctx(SortContext_t *ctx, long *result, long *array_b, long b_size, long *array_c, long c_size);
+
+// Sorts array using a private context of num_of_threads helper threads
+long *pthread_sort(long *array, long size, int num_of_threads);
+
+// Serial kernels of the engine, exported for the microbenchmarks
+long pthread_binary_search( long *search_array, long array_size, long value );
+void pthread_s_merge( long *result, long *array_b, long b_size, long *array_c, long c_size );
+void pthread_quicksort( long *result, long *source, long size );
+
+#endif  // _PTHREAD_SORT_H_
@@ -0,0 +1,331 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <string.h>
+#include <unistd.h>
+
+#include "auto_sort.h"
+#include "cilk_sort.h"
+#include "fork_join.h"
+#include "pthread_sort.h"
+
+// Python module "parsort": sorts any C contiguous buffer of 64-bit signed
+// integers (numpy.int64 arrays, array.array('q'), ...) with the sort
+// engines, in place or into a preallocated output buffer, without copying
+// through Python objects and with the GIL released.
+
+// Serial cut-off of the pthread engine unless the caller picks one
+#define DEFAULT_CUTOFF 512
+
+// Cost model of the auto engine; loaded from SORT_MODEL at import and
+// replaced by load_model, so it is only read or written under the GIL
+static CostModel_t model;
+
+///////////////////////////////////////////////////////////////////////////////
+//                          Function Implementation                          //
+///////////////////////////////////////////////////////////////////////////////
+
+// Accepts the buffer formats that denote a native 64-bit signed integer
+static int is_int64_format( const char *format, Py_ssize_t itemsize )
+{
+  if(itemsize != 8 || format == NULL)
+  {
+    return 0;
+  }
+  if(format[0] == '@' || format[0] == '=' || format[0] == '<' || format[0] == '>' || format[0] == '!')
+  {
+#if PY_BIG_ENDIAN
+    if(format[0] == '<')
+#else
+    if(format[0] == '>' || format[0] == '!')
+#endif
+    {
+      return 0;
+    }
+    format++;
+  }
+  return strcmp(format, "q") == 0 || (strcmp(format, "l") == 0 && sizeof(long) == 8);
+}
+
+static int get_int64_buffer( PyObject *object, Py_buffer *view, int writable, const char *name )
+{
+  int flags = PyBUF_C_CONTIGUOUS | PyBUF_FORMAT | (writable ? PyBUF_WRITABLE : 0);
+  if(PyObject_GetBuffer(object, view, flags) < 0)
+  {
+    return -1;
+  }
+  if(!is_int64_format(view->format, view->itemsize))
+  {
+    PyErr_Format(PyExc_TypeError, "%s must hold native 64-bit signed integers (format 'q'), not '%s'",
+                 name, view->format ? view->format : "B");
+    PyBuffer_Release(view);
+    return -1;
+  }
+  return 0;
+}
+
+static int parse_engine( const char *name, SortEngine_t *engine, int *automatic )
+{
+  *automatic = strcmp(name, "auto") == 0;
+  if(*automatic)
+  {
+    return 0;
+  }
+
+  int e;
+  for( e = ENGINE_SERIAL; e < ENGINE_COUNT; e++ )
+  {
+    if(e != ENGINE_COUNTING && strcmp(name, sort_engine_name((SortEngine_t)e)) == 0)
+    {
+      *engine = (SortEngine_t)e;
+      return 0;
+    }
+  }
+
+  PyErr_Format(PyExc_ValueError, "unknown engine '%s' (expected auto, serial, cilk, cache or pthread)", name);
+  return -1;
+}
+
+PyDoc_STRVAR(parsort_sort_doc,
+"sort(array, out=None, engine='auto', threads=0, cutoff=0)\n"
+"--\n"
+"\n"
+"Sorts a C contiguous buffer of int64 values. With out=None the buffer is\n"
+"sorted in place, otherwise array is left untouched and the result is\n"
+"written to out, a writable int64 buffer of the same length. Returns the\n"
+"sorted buffer (array or out).\n"
+"\n"
+"engine   'auto' (pick by cost model), 'serial', 'cilk', 'cache' or\n"
+"         'pthread'.\n"
+"threads  worker count; 0 uses every core. The cilk engines honour it\n"
+"         under the OpenMP backend only, as the Cilk runtimes fix their\n"
+"         worker count per process (CILK_NWORKERS).\n"
+"cutoff   serial cut-off of the pthread engine; 0 keeps the default. The\n"
+"         cilk engines use the cut-off they were built with (GRAIN).\n"
+"\n"
+"The GIL is released while sorting.");
+
+static PyObject *parsort_sort( PyObject *self, PyObject *args, PyObject *kwargs )
+{
+  static char *keywords[] = { "array", "out", "engine", "threads", "cutoff", NULL };
+  PyObject *array_object;
+  PyObject *out_object = Py_None;
+  const char *engine_name = "auto";
+  int threads = 0;
+  long cutoff = 0;
+
+  if(!PyArg_ParseTupleAndKeywords(args, kwargs, "O|Osil:sort", keywords,
+                                  &array_object, &out_object, &engine_name, &threads, &cutoff))
+  {
+    return NULL;
+  }
+
+  SortEngine_t engine = ENGINE_CILK;
+  int automatic;
+  if(parse_engine(engine_name, &engine, &automatic) < 0)
+  {
+    return NULL;
+  }
+  if(threads < 0 || cutoff < 0)
+  {
+    PyErr_SetString(PyExc_ValueError, "threads and cutoff must not be negative");
+    return NULL;
+  }
+
+  int in_place = out_object == Py_None;
+  Py_buffer source, result;
+
+  if(get_int64_buffer(array_object, &source, in_place, "array") < 0)
+  {
+    return NULL;
+  }
+  if(in_place)
+  {
+    result = source;
+  }
+  else
+  {
+    if(get_int64_buffer(out_object, &result, 1, "out") < 0)
+    {
+      PyBuffer_Release(&source);
+      return NULL;
+    }
+    if(result.len != source.len)
+    {
+      PyErr_SetString(PyExc_ValueError, "out must have the same length as array");
+      goto failure;
+    }
+
+    // the engines sort into result while still reading source, which is
+    // only safe when they are the same memory or do not overlap at all
+    char *source_bytes = source.buf;
+    char *result_bytes = result.buf;
+    if(source_bytes != result_bytes &&
+       source_bytes < result_bytes + result.len && result_bytes < source_bytes + source.len)
+    {
+      PyErr_SetString(PyExc_ValueError, "out partially overlaps array");
+      goto failure;
+    }
+  }
+
+  long size = (long)(source.len / 8);
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  CostModel_t snapshot = model;
+
+  Py_BEGIN_ALLOW_THREADS
+  SortPlan_t plan;
+  if(automatic)
+  {
+    plan = auto_sort_plan( &snapshot, source.buf, size );
+  }
+  else
+  {
+    plan.engine       = engine;
+    plan.thread_count = engine == ENGINE_SERIAL ? 1 : (cores > 0 ? (int)cores : 1);
+    plan.threshold    = DEFAULT_CUTOFF;
+  }
+
+  // explicit choices override the plan; the serial engine stays serial
+  if(threads > 0 && plan.engine != ENGINE_SERIAL)
+  {
+    plan.thread_count = threads;
+  }
+  if(cutoff > 0)
+  {
+    plan.threshold = cutoff;
+  }
+#if defined(SORT_BACKEND_OPENMP)
+  // the setting sticks to the calling thread, so it is undone afterwards
+  int saved_threads = omp_get_max_threads();
+  if(threads > 0)
+  {
+    omp_set_num_threads( threads );
+  }
+#endif
+
+  auto_sort_run( &plan, result.buf, source.buf, size );
+
+#if defined(SORT_BACKEND_OPENMP)
+  if(threads > 0)
+  {
+    omp_set_num_threads( saved_threads );
+  }
+#endif
+  Py_END_ALLOW_THREADS
+
+  PyObject *sorted = in_place ? array_object : out_object;
+  Py_INCREF(sorted);
+  if(!in_place)
+  {
+    PyBuffer_Release(&result);
+  }
+  PyBuffer_Release(&source);
+  return sorted;
+
+failure:
+  if(!in_place)
+  {
+    PyBuffer_Release(&result);
+  }
+  PyBuffer_Release(&source);
+  return NULL;
+}
+
+PyDoc_STRVAR(parsort_plan_doc,
+"plan(array)\n"
+"--\n"
+"\n"
+"Returns the choice the 'auto' engine would make for array as a dict with\n"
+"the keys engine, threads, cutoff, sortedness, distinct and predicted.");
+
+static PyObject *parsort_plan( PyObject *self, PyObject *array_object )
+{
+  Py_buffer source;
+  if(get_int64_buffer(array_object, &source, 0, "array") < 0)
+  {
+    return NULL;
+  }
+
+  SortPlan_t plan;
+  CostModel_t snapshot = model;
+  Py_BEGIN_ALLOW_THREADS
+  plan = auto_sort_plan( &snapshot, source.buf, (long)(source.len / 8) );
+  Py_END_ALLOW_THREADS
+  PyBuffer_Release(&source);
+
+  return Py_BuildValue("{s:s,s:i,s:l,s:d,s:l,s:d}",
+                       "engine", sort_engine_name(plan.engine),
+                       "threads", plan.thread_count,
+                       "cutoff", plan.threshold,
+                       "sortedness", plan.sortedness,
+                       "distinct", plan.distinct,
+                       "predicted", plan.predicted);
+}
+
+PyDoc_STRVAR(parsort_load_model_doc,
+"load_model(path)\n"
+"--\n"
+"\n"
+"Replaces the cost model of the 'auto' engine with one written by\n"
+"./sort --calibrate. Raises OSError when the file cannot be used.");
+
+static PyObject *parsort_load_model( PyObject *self, PyObject *args )
+{
+  const char *path;
+  if(!PyArg_ParseTuple(args, "s:load_model", &path))
+  {
+    return NULL;
+  }
+
+  CostModel_t loaded = model;
+  if(!auto_sort_load_model(&loaded, path))
+  {
+    PyErr_Format(PyExc_OSError, "cannot load cost model from '%s'", path);
+    return NULL;
+  }
+  model = loaded;
+
+  Py_RETURN_NONE;
+}
+
+static PyMethodDef parsort_methods[] =
+{
+  { "sort", (PyCFunction)(void (*)(void))parsort_sort, METH_VARARGS | METH_KEYWORDS, parsort_sort_doc },
+  { "plan", (PyCFunction)parsort_plan, METH_O, parsort_plan_doc },
+  { "load_model", (PyCFunction)parsort_load_model, METH_VARARGS, parsort_load_model_doc },
+  { NULL, NULL, 0, NULL }
+};
+
+static struct PyModuleDef parsort_module =
+{
+  PyModuleDef_HEAD_INIT,
+  "parsort",
+  "Parallel sort engines for int64 buffers (see parsort.sort).",
+  -1,
+  parsort_methods
+};
+
+PyMODINIT_FUNC PyInit_parsort( void )
+{
+  auto_sort_default_model( &model );
+  const char *model_path = getenv("SORT_MODEL");
+  if(model_path != NULL)
+  {
+    auto_sort_load_model( &model, model_path );
+  }
+
+  PyObject *module = PyModule_Create(&parsort_module);
+  if(module == NULL)
+  {
+    return NULL;
+  }
+
+  if(PyModule_AddStringConstant(module, "backend", SORT_BACKEND_NAME) < 0 ||
+     PyModule_AddObject(module, "engines", Py_BuildValue("(sssss)", "auto", "serial", "cilk", "cache", "pthread")) < 0)
+  {
+    Py_DECREF(module);
+    return NULL;
+  }
+
+  return module;
+}
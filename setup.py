@@ -0,0 +1,44 @@
+#!/usr/bin/python
+
+# Builds the parsort Python extension (pysort.c) over the sort engines:
+#
+#   python setup.py build_ext --inplace
+#
+# BACKEND selects the fork-join runtime of the cilk engine as in the
+# Makefile: openmp (the default here, as Python extensions are normally
+# built with the stock compiler), opencilk or cilkplus. For the Cilk
+# backends point CC at a Cilk capable compiler, e.g.
+#
+#   CC=/opt/opencilk/bin/clang BACKEND=opencilk python setup.py build_ext --inplace
+#
+# GRAIN overrides the serial cut-off of the cilk engine.
+
+import os
+from setuptools import setup, Extension
+
+BACKENDS = {
+    'openmp':   (['-fopenmp', '-DSORT_BACKEND_OPENMP'], ['-fopenmp', '-lpthread']),
+    'opencilk': (['-fopencilk', '-DSORT_BACKEND_OPENCILK'], ['-fopencilk', '-lpthread']),
+    'cilkplus': (['-fcilkplus'], ['-lcilkrts', '-lpthread']),
+}
+
+backend = os.environ.get('BACKEND', 'openmp')
+if backend not in BACKENDS:
+    raise SystemExit('unknown BACKEND ' + backend + ', expected one of ' + ', '.join(sorted(BACKENDS)))
+
+compile_args, link_args = BACKENDS[backend]
+compile_args = ['-O3'] + compile_args
+if 'GRAIN' in os.environ:
+    compile_args.append('-DTHRESHOLD=' + os.environ['GRAIN'])
+
+sources = ['pysort.c', 'auto_sort.c', 'cilk_sort.c', 'cilk_lowcard.c',
+           'cilk_tiled.c', 'pthread_sort.c', 'ktiming.c']
+
+setup(
+    name='parsort',
+    version='1.0',
+    description='Parallel merge sort engines for int64 buffers',
+    ext_modules=[Extension('parsort', sources=sources,
+                           extra_compile_args=compile_args,
+                           extra_link_args=link_args)],
+)
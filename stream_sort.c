@@ -0,0 +1,480 @@
+#include <pthread.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pthread_sort.h"
+#include "stream_sort.h"
+
+// Default number of keys gathered into one chunk before it is handed to a
+// worker to be sorted into a run
+#define CHUNK_SIZE (1L << 20)
+
+#define TRUE 1
+#define FALSE 0
+
+///////////////////////////////////////////////////////////////////////////////
+//                             Type Declarations                             //
+///////////////////////////////////////////////////////////////////////////////
+
+// A sorted run. Chunks produce level 0 runs and merging two runs of level l
+// produces a run of level l + 1, so runs of one level have similar sizes.
+typedef struct Run
+{
+  long *data;
+  long size;
+  int level;
+  struct Run *next;
+} Run_t;
+
+typedef enum
+{
+  TASK_SORT,
+  TASK_MERGE
+} TaskType_t;
+
+// Unit of work handed to the workers: sort a chunk into a run, or merge two
+// runs of the same level
+typedef struct Task
+{
+  TaskType_t type;
+  long *chunk;
+  long size;
+  Run_t *run_b;
+  Run_t *run_c;
+  struct Task *next;
+} Task_t;
+
+struct StreamSorter
+{
+  // protects every field below up to the ingestion buffer
+  pthread_mutex_t mutex;
+
+  // signalled when a task is queued or the workers must exit
+  pthread_cond_t work_ready;
+
+  // signalled when the last outstanding task completes
+  pthread_cond_t all_done;
+
+  pthread_t *workers;
+  int worker_count;
+  int shutdown;
+
+  // FIFO of tasks waiting for a worker
+  Task_t *task_head;
+  Task_t *task_tail;
+
+  // number of tasks queued or running
+  long pending;
+
+  // completed runs that are not being merged
+  Run_t *runs;
+
+  // set by stream_sort_finish: completed runs are no longer paired into
+  // background merges, which would run on run_ctx without helpers, and
+  // are left for the final merge on final_ctx instead
+  int finishing;
+
+  // ingestion buffer; only touched by the thread pushing keys
+  long *chunk;
+  long chunk_fill;
+  long chunk_size;
+
+  // serial budget for the per-chunk sorts and background merges (the
+  // workers themselves provide the parallelism) and the full budget for
+  // the final merge, which runs once the workers are idle
+  SortContext_t *run_ctx;
+  SortContext_t *final_ctx;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//                          Function Implementation                          //
+///////////////////////////////////////////////////////////////////////////////
+
+// Must be called with the mutex held
+static void enqueue_task( StreamSorter_t *stream, Task_t *task )
+{
+  task->next = NULL;
+  if(stream->task_tail == NULL)
+  {
+    stream->task_head = task;
+  }
+  else
+  {
+    stream->task_tail->next = task;
+  }
+  stream->task_tail = task;
+  stream->pending++;
+  pthread_cond_signal( &stream->work_ready );
+}
+
+// Records a completed run, pairing it with a waiting run of the same level
+// when there is one. Must be called with the mutex held.
+static void complete_run( StreamSorter_t *stream, Run_t *run )
+{
+  Run_t **link = &stream->runs;
+  while(stream->finishing == FALSE && *link != NULL && (*link)->level != run->level)
+  {
+    link = &(*link)->next;
+  }
+
+  if(stream->finishing == TRUE || *link == NULL)
+  {
+    run->next = stream->runs;
+    stream->runs = run;
+    return;
+  }
+
+  Run_t *partner = *link;
+  *link = partner->next;
+
+  Task_t *task = malloc(sizeof(Task_t));
+  if(task == 0)
+  {
+    printf("ERROR: Insufficient Memory\n");
+    exit(-1);
+  }
+  task->type  = TASK_MERGE;
+  task->chunk = NULL;
+  task->size  = partner->size + run->size;
+  task->run_b = partner;
+  task->run_c = run;
+  enqueue_task( stream, task );
+}
+
+static Run_t *execute_task( StreamSorter_t *stream, Task_t *task )
+{
+  Run_t *run = malloc(sizeof(Run_t));
+  long *data = malloc(sizeof(long) * task->size);
+  if(run == 0 || data == 0)
+  {
+    printf("ERROR: Insufficient Memory; size=%ld\n", task->size);
+    exit(-1);
+  }
+  run->data = data;
+  run->size = task->size;
+  run->next = NULL;
+
+  if(task->type == TASK_SORT)
+  {
+    pthread_sort_into_ctx( stream->run_ctx, data, task->chunk, task->size );
+    free(task->chunk);
+    run->level = 0;
+  }
+  else
+  {
+    pthread_merge_ctx( stream->run_ctx, data,
+                       task->run_b->data, task->run_b->size,
+                       task->run_c->data, task->run_c->size );
+    run->level = task->run_b->level + 1;
+    free(task->run_b->data);
+    free(task->run_b);
+    free(task->run_c->data);
+    free(task->run_c);
+  }
+
+  return run;
+}
+
+static void* stream_worker( void *args )
+{
+  StreamSorter_t *stream = (StreamSorter_t*)args;
+
+  pthread_mutex_lock( &stream->mutex );
+  while(TRUE)
+  {
+    while(stream->task_head == NULL && stream->shutdown == FALSE)
+    {
+      pthread_cond_wait( &stream->work_ready, &stream->mutex );
+    }
+    if(stream->task_head == NULL)
+    {
+      break;
+    }
+
+    Task_t *task = stream->task_head;
+    stream->task_head = task->next;
+    if(stream->task_head == NULL)
+    {
+      stream->task_tail = NULL;
+    }
+    pthread_mutex_unlock( &stream->mutex );
+
+    Run_t *run = execute_task( stream, task );
+    free(task);
+
+    pthread_mutex_lock( &stream->mutex );
+    complete_run( stream, run );
+    stream->pending--;
+    if(stream->pending == 0)
+    {
+      pthread_cond_broadcast( &stream->all_done );
+    }
+  }
+  pthread_mutex_unlock( &stream->mutex );
+
+  return NULL;
+}
+
+// Hands the current chunk to the workers and starts a new one
+static int flush_chunk( StreamSorter_t *stream )
+{
+  if(stream->chunk_fill == 0)
+  {
+    return TRUE;
+  }
+
+  Task_t *task = malloc(sizeof(Task_t));
+  if(task == 0)
+  {
+    printf("ERROR: Insufficient Memory\n");
+    return FALSE;
+  }
+  task->type  = TASK_SORT;
+  task->chunk = stream->chunk;
+  task->size  = stream->chunk_fill;
+  task->run_b = NULL;
+  task->run_c = NULL;
+
+  pthread_mutex_lock( &stream->mutex );
+  enqueue_task( stream, task );
+  pthread_mutex_unlock( &stream->mutex );
+
+  stream->chunk = NULL;
+  stream->chunk_fill = 0;
+  return TRUE;
+}
+
+StreamSorter_t *stream_sort_create( int num_of_threads, long chunk_size )
+{
+  if(num_of_threads < 1)
+  {
+    num_of_threads = 1;
+  }
+  if(chunk_size <= 0)
+  {
+    chunk_size = CHUNK_SIZE;
+  }
+
+  StreamSorter_t *stream = calloc(1, sizeof(StreamSorter_t));
+  pthread_t *workers = malloc(sizeof(pthread_t) * num_of_threads);
+  if(stream == 0 || workers == 0)
+  {
+    printf("Insufficient Memory\n");
+    free(stream);
+    free(workers);
+    return NULL;
+  }
+
+  stream->workers    = workers;
+  stream->chunk_size = chunk_size;
+  stream->run_ctx    = pthread_sort_context_create( 0 );
+  stream->final_ctx  = pthread_sort_context_create( num_of_threads - 1 );
+  if(stream->run_ctx == NULL || stream->final_ctx == NULL)
+  {
+    pthread_sort_context_destroy( stream->run_ctx );
+    pthread_sort_context_destroy( stream->final_ctx );
+    free(workers);
+    free(stream);
+    return NULL;
+  }
+
+  pthread_mutex_init( &stream->mutex, NULL );
+  pthread_cond_init( &stream->work_ready, NULL );
+  pthread_cond_init( &stream->all_done, NULL );
+
+  for( stream->worker_count = 0; stream->worker_count < num_of_threads; stream->worker_count++ )
+  {
+    if(pthread_create( &workers[stream->worker_count], NULL, &stream_worker, stream ) != 0)
+    {
+      printf("ERROR: Failed to create stream worker\n");
+      break;
+    }
+  }
+
+  if(stream->worker_count == 0)
+  {
+    stream_sort_destroy( stream );
+    return NULL;
+  }
+
+  return stream;
+}
+
+void stream_sort_destroy( StreamSorter_t *stream )
+{
+  if(stream == NULL)
+  {
+    return;
+  }
+
+  pthread_mutex_lock( &stream->mutex );
+  stream->shutdown = TRUE;
+  pthread_cond_broadcast( &stream->work_ready );
+  pthread_mutex_unlock( &stream->mutex );
+
+  // the workers drain the queue before they exit
+  int i;
+  for( i = 0; i < stream->worker_count; i++ )
+  {
+    pthread_join( stream->workers[i], NULL );
+  }
+
+  while(stream->runs != NULL)
+  {
+    Run_t *run = stream->runs;
+    stream->runs = run->next;
+    free(run->data);
+    free(run);
+  }
+
+  pthread_cond_destroy( &stream->all_done );
+  pthread_cond_destroy( &stream->work_ready );
+  pthread_mutex_destroy( &stream->mutex );
+  pthread_sort_context_destroy( stream->run_ctx );
+  pthread_sort_context_destroy( stream->final_ctx );
+  free(stream->chunk);
+  free(stream->workers);
+  free(stream);
+}
+
+int stream_sort_push( StreamSorter_t *stream, const long *keys, long count )
+{
+  while(count > 0)
+  {
+    if(stream->chunk == NULL)
+    {
+      stream->chunk = malloc(sizeof(long) * stream->chunk_size);
+      if(stream->chunk == 0)
+      {
+        printf("ERROR: Insufficient Memory; size=%ld\n", stream->chunk_size);
+        return FALSE;
+      }
+    }
+
+    long space = stream->chunk_size - stream->chunk_fill;
+    long copy = count < space ? count : space;
+    memcpy( stream->chunk + stream->chunk_fill, keys, sizeof(long) * copy );
+    stream->chunk_fill += copy;
+    keys  += copy;
+    count -= copy;
+
+    if(stream->chunk_fill == stream->chunk_size && !flush_chunk(stream))
+    {
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+long *stream_sort_finish( StreamSorter_t *stream, long *size )
+{
+  *size = 0;
+
+  pthread_mutex_lock( &stream->mutex );
+  stream->finishing = TRUE;
+
+  // Step 1. Take back the background merges no worker has started; their
+  //         runs join the final merge, which has every thread to use
+  Task_t **link = &stream->task_head;
+  stream->task_tail = NULL;
+  while(*link != NULL)
+  {
+    Task_t *task = *link;
+    if(task->type == TASK_MERGE)
+    {
+      *link = task->next;
+      task->run_b->next = task->run_c;
+      task->run_c->next = stream->runs;
+      stream->runs = task->run_b;
+      stream->pending--;
+      free(task);
+    }
+    else
+    {
+      stream->task_tail = task;
+      link = &task->next;
+    }
+  }
+  pthread_mutex_unlock( &stream->mutex );
+
+  if(!flush_chunk(stream))
+  {
+    pthread_mutex_lock( &stream->mutex );
+    stream->finishing = FALSE;
+    pthread_mutex_unlock( &stream->mutex );
+    return NULL;
+  }
+
+  // Step 2. Wait for the sorts and the merges already running
+  pthread_mutex_lock( &stream->mutex );
+  while(stream->pending > 0)
+  {
+    pthread_cond_wait( &stream->all_done, &stream->mutex );
+  }
+  Run_t *runs = stream->runs;
+  stream->runs = NULL;
+  stream->finishing = FALSE;
+  pthread_mutex_unlock( &stream->mutex );
+
+  if(runs == NULL)
+  {
+    return malloc(sizeof(long));
+  }
+
+  // Step 3. Merge the remaining runs smallest first with the parallel merge
+  //         so each key is moved a minimal number of times. Runs are kept
+  //         ordered by size in the list.
+  Run_t *sorted_runs = NULL;
+  while(runs != NULL)
+  {
+    Run_t *run = runs;
+    runs = run->next;
+
+    Run_t **link = &sorted_runs;
+    while(*link != NULL && (*link)->size < run->size)
+    {
+      link = &(*link)->next;
+    }
+    run->next = *link;
+    *link = run;
+  }
+
+  while(sorted_runs->next != NULL)
+  {
+    Run_t *run_b = sorted_runs;
+    Run_t *run_c = sorted_runs->next;
+    sorted_runs = run_c->next;
+
+    long merged_size = run_b->size + run_c->size;
+    long *merged = malloc(sizeof(long) * merged_size);
+    if(merged == 0)
+    {
+      printf("ERROR: Insufficient Memory; size=%ld\n", merged_size);
+      exit(-1);
+    }
+    pthread_merge_ctx( stream->final_ctx, merged, run_b->data, run_b->size, run_c->data, run_c->size );
+
+    free(run_b->data);
+    free(run_c->data);
+    free(run_c);
+    run_b->data = merged;
+    run_b->size = merged_size;
+
+    Run_t **link = &sorted_runs;
+    while(*link != NULL && (*link)->size < run_b->size)
+    {
+      link = &(*link)->next;
+    }
+    run_b->next = *link;
+    *link = run_b;
+  }
+
+  long *result = sorted_runs->data;
+  *size = sorted_runs->size;
+  free(sorted_runs);
+
+  return result;
+}
@@ -0,0 +1,22 @@
+#ifndef _STREAM_SORT_H_
+#define _STREAM_SORT_H_
+
+// Opaque streaming sorter. Keys pushed into it are cut into chunks that are
+// sorted into runs on worker threads while ingestion continues; runs of equal
+// size are merged in the background so that finishing the stream only has to
+// merge a logarithmic number of runs.
+typedef struct StreamSorter StreamSorter_t;
+
+// chunk_size is the number of keys per run; 0 selects the default
+StreamSorter_t *stream_sort_create( int num_of_threads, long chunk_size );
+void stream_sort_destroy( StreamSorter_t *stream );
+
+// Appends count keys to the stream; the keys are copied
+int stream_sort_push( StreamSorter_t *stream, const long *keys, long count );
+
+// Ends the stream and returns a newly allocated array of every key pushed so
+// far in sorted order, storing its length in size. The sorter is empty
+// afterwards and may be reused for another stream.
+long *stream_sort_finish( StreamSorter_t *stream, long *size );
+
+#endif  // _STREAM_SORT_H_
@@ -0,0 +1,415 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "string_sort.h"
+#include "fork_join.h"
+
+// Specifies the cut-off size of the array before it switches from
+// parallel merges/sorts to a serial implementation
+#ifndef THRESHOLD
+#define THRESHOLD 512
+#endif
+
+// Number of leading string bytes cached next to each reference
+#define PREFIX_BYTES 8
+
+// Subarrays below this size are finished by insertion sort inside the
+// multikey quicksort
+#define INSERTION_THRESHOLD 16
+
+// Number of references converted by one strand when building the items
+#define BLOCK_SIZE 16384
+
+// Sort record of one string: the reference, its first PREFIX_BYTES bytes
+// packed big endian (zero padded) so that integer order is byte order, and
+// the length of the prefix it shares with its predecessor in the sorted run
+typedef struct
+{
+  uint64_t prefix;
+  long offset;
+  long length;
+  long lcp;
+} StringItem_t;
+
+///////////////////////////////////////////////////////////////////////////////
+//                          Function Implementation                          //
+///////////////////////////////////////////////////////////////////////////////
+
+static uint64_t load_prefix( const unsigned char *bytes, long length )
+{
+  uint64_t prefix = 0;
+  long i;
+
+  for( i = 0; i < PREFIX_BYTES; i++ )
+  {
+    prefix = (prefix << 8) | (i < length ? bytes[i] : 0);
+  }
+  return prefix;
+}
+
+// Byte of item at depth, or -1 past its end
+static inline int char_at( const StringItem_t *item, long depth, const char *arena )
+{
+  if(depth >= item->length)
+  {
+    return -1;
+  }
+  if(depth < PREFIX_BYTES)
+  {
+    return (int)((item->prefix >> (8 * (PREFIX_BYTES - 1 - depth))) & 0xff);
+  }
+  return ((const unsigned char *)arena)[item->offset + depth];
+}
+
+// Three-way comparison of two strings known to agree on their first depth
+// bytes. The length of their common prefix is returned through lcp.
+static int compare_items( const StringItem_t *a, const StringItem_t *b, long depth, const char *arena, long *lcp )
+{
+  long min_length = a->length < b->length ? a->length : b->length;
+
+  if(depth < PREFIX_BYTES)
+  {
+    // zero padding past the end of a string still orders correctly: it can
+    // only tie with a real '\0' byte, never decide against it. Such a tie
+    // does count towards the common prefix, hence the clamp to min_length.
+    if(a->prefix != b->prefix)
+    {
+      long differ = __builtin_clzll(a->prefix ^ b->prefix) / 8;
+      *lcp = differ < min_length ? differ : min_length;
+      return a->prefix < b->prefix ? -1 : 1;
+    }
+    depth = min_length < PREFIX_BYTES ? min_length : PREFIX_BYTES;
+  }
+
+  const unsigned char *bytes_a = (const unsigned char *)arena + a->offset;
+  const unsigned char *bytes_b = (const unsigned char *)arena + b->offset;
+  while(depth < min_length && bytes_a[depth] == bytes_b[depth])
+  {
+    depth++;
+  }
+
+  *lcp = depth;
+  if(depth < min_length)
+  {
+    return bytes_a[depth] < bytes_b[depth] ? -1 : 1;
+  }
+  return (a->length > b->length) - (a->length < b->length);
+}
+
+static void insertion_sort_items( StringItem_t *items, long size, long depth, const char *arena )
+{
+  long i, j, lcp;
+
+  for( i = 1; i < size; i++ )
+  {
+    StringItem_t value = items[i];
+    for( j = i; j > 0 && compare_items(&items[j - 1], &value, depth, arena, &lcp) > 0; j-- )
+    {
+      items[j] = items[j - 1];
+    }
+    items[j] = value;
+  }
+}
+
+static inline void swap_items( StringItem_t *items, long i, long j )
+{
+  StringItem_t tmp = items[i];
+  items[i] = items[j];
+  items[j] = tmp;
+}
+
+// Multikey quicksort (Bentley and Sedgewick) of items that agree on their
+// first depth bytes: a three-way partition on the byte at depth, after which
+// only the equal class advances to the next byte
+static void multikey_quicksort( StringItem_t *items, long size, long depth, const char *arena )
+{
+  while(size > INSERTION_THRESHOLD)
+  {
+    // median of three bytes as the pivot
+    int first = char_at( &items[0], depth, arena );
+    int middle = char_at( &items[size / 2], depth, arena );
+    int last = char_at( &items[size - 1], depth, arena );
+    int pivot = first < middle ? (middle < last ? middle : (first < last ? last : first))
+                               : (first < last ? first : (middle < last ? last : middle));
+
+    long lt = 0;
+    long gt = size - 1;
+    long i = 0;
+    while(i <= gt)
+    {
+      int byte = char_at( &items[i], depth, arena );
+      if(byte < pivot)
+      {
+        swap_items( items, lt++, i++ );
+      }
+      else if(byte > pivot)
+      {
+        swap_items( items, i, gt-- );
+      }
+      else
+      {
+        i++;
+      }
+    }
+
+    multikey_quicksort( items, lt, depth, arena );
+    multikey_quicksort( items + gt + 1, size - gt - 1, depth, arena );
+
+    // strings that ended at depth are all equal and need no more work
+    if(pivot < 0)
+    {
+      return;
+    }
+    items += lt;
+    size = gt + 1 - lt;
+    depth++;
+  }
+
+  insertion_sort_items( items, size, depth, arena );
+}
+
+static void leaf_sort( StringItem_t *result, StringItem_t *source, long size, const char *arena )
+{
+  if(result != source)
+  {
+    memcpy( result, source, sizeof(StringItem_t) * size );
+  }
+  multikey_quicksort( result, size, 0, arena );
+
+  long i;
+  if(size > 0)
+  {
+    result[0].lcp = 0;
+  }
+  for( i = 1; i < size; i++ )
+  {
+    compare_items( &result[i - 1], &result[i], 0, arena, &result[i].lcp );
+  }
+}
+
+// Serial LCP merge. lcp_b and lcp_c hold the common prefix length of each
+// head with the item last written; the head sharing more with it is the
+// smaller one, so bytes are only compared when the two lengths tie, and then
+// only from that length on. The first item written gets lcp 0; its real
+// value depends on what precedes result and is fixed by the caller.
+static void s_merge_lcp( StringItem_t *result, StringItem_t *array_b, long b_size, StringItem_t *array_c, long c_size, const char *arena )
+{
+  long lcp_b = 0;
+  long lcp_c = 0;
+
+  while( b_size > 0 && c_size > 0 )
+  {
+    int take_b;
+    long lcp = 0;
+
+    if(lcp_b != lcp_c)
+    {
+      take_b = lcp_b > lcp_c;
+    }
+    else
+    {
+      take_b = compare_items( array_b, array_c, lcp_b, arena, &lcp ) <= 0;
+    }
+
+    if(take_b)
+    {
+      *result = *array_b++;
+      result->lcp = lcp_b;
+      result++; b_size--;
+      if(lcp_b == lcp_c)
+      {
+        lcp_c = lcp;
+      }
+      lcp_b = b_size > 0 ? array_b->lcp : 0;
+    }
+    else
+    {
+      *result = *array_c++;
+      result->lcp = lcp_c;
+      result++; c_size--;
+      if(lcp_b == lcp_c)
+      {
+        lcp_b = lcp;
+      }
+      lcp_c = c_size > 0 ? array_c->lcp : 0;
+    }
+  }
+
+  if( b_size > 0 )
+  {
+    memcpy( result, array_b, sizeof(StringItem_t) * b_size );
+    result->lcp = lcp_b;
+  }
+
+  if( c_size > 0 )
+  {
+    memcpy( result, array_c, sizeof(StringItem_t) * c_size );
+    result->lcp = lcp_c;
+  }
+}
+
+// Number of items of search_array that are smaller than value
+static long string_binary_search( StringItem_t *search_array, long array_size, const StringItem_t *value, const char *arena )
+{
+  long min = 0;
+  long max = array_size;
+  long lcp;
+
+  while(min < max)
+  {
+    long mid = min + (max - min) / 2;
+    if(compare_items( &search_array[mid], value, 0, arena, &lcp ) < 0)
+    {
+      min = mid + 1;
+    }
+    else
+    {
+      max = mid;
+    }
+  }
+
+  return min;
+}
+
+static void p_merge_lcp( StringItem_t *result, StringItem_t *array_b, long b_size, StringItem_t *array_c, long c_size, const char *arena )
+{
+
+  // invert the array that is considered B as B needs to be the larger one
+  if(b_size < c_size)
+  {
+    p_merge_lcp( result, array_c, c_size, array_b, b_size, arena );
+  }
+  else if( b_size <= THRESHOLD || c_size == 0 )
+  {
+    // perform sequential merge rather than parallel
+    s_merge_lcp( result, array_b, b_size, array_c, c_size, arena );
+  }
+  else
+  {
+    long mid_index = b_size / 2;
+    long bin_index = string_binary_search( array_c, c_size, &array_b[mid_index], arena );
+    long split = mid_index + bin_index;
+
+    result[split] = array_b[mid_index];
+
+    // handle values less than the mid_index value within B
+    cilk_spawn p_merge_lcp( result, array_b, mid_index, array_c, bin_index, arena );
+
+    // handle values larger than the mid_index value within B
+    p_merge_lcp( result + split + 1, array_b + mid_index + 1, b_size - mid_index - 1, array_c + bin_index, c_size - bin_index, arena );
+
+    // wait for all spawned threads to be completed
+    cilk_sync;
+
+    // the halves were merged without knowing their neighbours; repair the
+    // common prefix lengths across the two seams around the split item
+    if(split > 0)
+    {
+      compare_items( &result[split - 1], &result[split], 0, arena, &result[split].lcp );
+    }
+    if(split + 1 < b_size + c_size)
+    {
+      compare_items( &result[split], &result[split + 1], 0, arena, &result[split + 1].lcp );
+    }
+  }
+
+}
+
+static void string_merge_sort( StringItem_t *result, StringItem_t *source, long size, const char *arena )
+{
+
+  if(size <= THRESHOLD)
+  {
+    leaf_sort( result, source, size, arena );
+  }
+  else
+  {
+
+    StringItem_t *C = malloc(size * sizeof(StringItem_t));
+    if(C == 0)
+    {
+      printf("ERROR: Insufficient Memory; size=%ld\n", size);
+      exit(-1);
+    }
+
+    cilk_spawn string_merge_sort(C, source, size / 2, arena);
+    string_merge_sort(C + (size / 2), source + (size / 2), size - (size / 2), arena);
+    cilk_sync;
+
+    p_merge_lcp( result, C, (size / 2), C + (size / 2), size - (size / 2), arena );
+    result[0].lcp = 0;
+
+    free(C);
+  }
+
+}
+
+static void build_items( StringItem_t *items, const StringRef_t *refs, long size, const char *arena )
+{
+  if(size > BLOCK_SIZE)
+  {
+    long half = size / 2;
+    cilk_spawn build_items( items, refs, half, arena );
+    build_items( items + half, refs + half, size - half, arena );
+    cilk_sync;
+    return;
+  }
+
+  long i;
+  for( i = 0; i < size; i++ )
+  {
+    items[i].offset = refs[i].offset;
+    items[i].length = refs[i].length;
+    items[i].prefix = load_prefix( (const unsigned char *)arena + refs[i].offset, refs[i].length );
+    items[i].lcp    = 0;
+  }
+}
+
+static void store_refs( StringRef_t *refs, const StringItem_t *items, long size )
+{
+  if(size > BLOCK_SIZE)
+  {
+    long half = size / 2;
+    cilk_spawn store_refs( refs, items, half );
+    store_refs( refs + half, items + half, size - half );
+    cilk_sync;
+    return;
+  }
+
+  long i;
+  for( i = 0; i < size; i++ )
+  {
+    refs[i].offset = items[i].offset;
+    refs[i].length = items[i].length;
+  }
+}
+
+void cilk_string_sort_into(const char *arena, StringRef_t *result, const StringRef_t *source, long count)
+{
+  if(count <= 0)
+  {
+    return;
+  }
+
+  StringItem_t *items = malloc(sizeof(StringItem_t) * count);
+  if(items == 0)
+  {
+    printf("ERROR: Insufficient Memory; size=%ld\n", count);
+    exit(-1);
+  }
+
+  // the items are sorted in place: the merge sort ping-pongs between them
+  // and the per level buffers it allocates
+  FORK_JOIN_ROOT( build_items( items, source, count, arena ) );
+  FORK_JOIN_ROOT( string_merge_sort( items, items, count, arena ) );
+  FORK_JOIN_ROOT( store_refs( result, items, count ) );
+
+  free(items);
+}
+
+void cilk_string_sort(const char *arena, StringRef_t *refs, long count)
+{
+  cilk_string_sort_into( arena, refs, refs, count );
+}
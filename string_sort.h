@@ -0,0 +1,19 @@
+#ifndef _STRING_SORT_H_
+#define _STRING_SORT_H_
+
+// A variable length byte string stored in a caller owned arena as the bytes
+// arena[offset .. offset + length). Strings may contain any byte value,
+// including '\0'.
+typedef struct
+{
+  long offset;
+  long length;
+} StringRef_t;
+
+// Sorts the references by the bytes they point to (unsigned, lexicographic;
+// a proper prefix sorts before the longer string). Only the references are
+// moved, the arena is never written. source and result may be the same array.
+void cilk_string_sort_into(const char *arena, StringRef_t *result, const StringRef_t *source, long count);
+void cilk_string_sort(const char *arena, StringRef_t *refs, long count);
+
+#endif  // _STRING_SORT_H_